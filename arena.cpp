@@ -0,0 +1,25 @@
+#include "arena.hpp"
+
+static std::pmr::monotonic_buffer_resource *route_resource(void) {
+    alignas(std::max_align_t) static unsigned char buffer[ROUTE_ARENA_SIZE];
+    static std::pmr::monotonic_buffer_resource resource {
+        buffer, sizeof(buffer), std::pmr::new_delete_resource()};
+
+    return &resource;
+}
+
+std::pmr::memory_resource *route_arena(void) {
+    return route_resource();
+}
+
+void route_arena_reset(void) {
+    route_resource()->release();
+}
+
+std::pmr::memory_resource *board_arena(void) {
+    /* Never destroyed: the static leads and traces release into it on exit */
+    static auto *pool = new std::pmr::unsynchronized_pool_resource {
+        std::pmr::new_delete_resource()};
+
+    return pool;
+}
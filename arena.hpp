@@ -0,0 +1,19 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <memory_resource>
+
+/* Bytes of the route arena kept in place between routes */
+#define ROUTE_ARENA_SIZE (64 * 1024)
+
+/* Temporaries of the connection being routed: paths, corners and the trace
+ * footprint before it is committed. Released in bulk by route_arena_reset(). */
+std::pmr::memory_resource *route_arena(void);
+
+void route_arena_reset(void);
+
+/* Committed trace data. Blocks are pooled by size, so ripped up traces are
+ * reused by their reroutes instead of fragmenting the heap over a session. */
+std::pmr::memory_resource *board_arena(void);
+
+#endif
@@ -0,0 +1,66 @@
+#include "bucket.hpp"
+#include <stdint.h>
+
+void bucket_clear(struct bucket_queue *queue) {
+    for (size_t key = queue->cursor; queue->size && key < queue->buckets.size(); key++) {
+        queue->size -= queue->buckets[key].size();
+        queue->buckets[key].clear();
+    }
+
+    queue->cursor = 0;
+    queue->size = 0;
+}
+
+/* Keys below the cursor move it back */
+void bucket_push(struct bucket_queue *queue, size_t key, struct node *node) {
+    if (key >= queue->buckets.size()) {
+        queue->buckets.resize(key + key / 2 + 1);
+    }
+
+    if (key < queue->cursor || !queue->size) {
+        queue->cursor = key;
+    }
+
+    queue->buckets[key].push_back(node);
+    queue->size++;
+}
+
+struct node *bucket_pop(struct bucket_queue *queue) {
+    if (!queue->size) {
+        return NULL;
+    }
+
+    while (queue->buckets[queue->cursor].empty()) {
+        queue->cursor++;
+    }
+
+    struct node *node = queue->buckets[queue->cursor].back();
+    queue->buckets[queue->cursor].pop_back();
+    queue->size--;
+
+    return node;
+}
+
+/* Smallest key in the queue, SIZE_MAX when empty */
+size_t bucket_top(struct bucket_queue *queue) {
+    if (!queue->size) {
+        return SIZE_MAX;
+    }
+
+    while (queue->buckets[queue->cursor].empty()) {
+        queue->cursor++;
+    }
+
+    return queue->cursor;
+}
+
+/* Move every entry, stale ones included, to out and empty the queue */
+void bucket_drain(struct bucket_queue *queue, std::vector<struct node *> &out) {
+    for (size_t key = queue->cursor; queue->size && key < queue->buckets.size(); key++) {
+        out.insert(out.end(), queue->buckets[key].begin(), queue->buckets[key].end());
+        queue->size -= queue->buckets[key].size();
+        queue->buckets[key].clear();
+    }
+
+    queue->cursor = 0;
+}
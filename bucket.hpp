@@ -0,0 +1,30 @@
+#ifndef BUCKET_HPP
+#define BUCKET_HPP
+
+#include <vector>
+
+#include "grid.hpp"
+
+/* Monotone bucket (Dial) queue over small integer keys. Buckets are indexed
+ * by the key itself, so push and pop are O(1) amortised as long as popped
+ * keys never decrease, which holds for A* with a consistent heuristic, and
+ * stay cheap when they only drop a little, as with a weighted heuristic.
+ * Entries aren't removed on decrease-key, callers skip stale ones. */
+struct bucket_queue {
+    std::vector<std::vector<struct node *>> buckets;
+    /* No entry has a key below cursor */
+    size_t cursor;
+    size_t size;
+};
+
+void bucket_clear(struct bucket_queue *queue);
+
+void bucket_push(struct bucket_queue *queue, size_t key, struct node *node);
+
+struct node *bucket_pop(struct bucket_queue *queue);
+
+size_t bucket_top(struct bucket_queue *queue);
+
+void bucket_drain(struct bucket_queue *queue, std::vector<struct node *> &out);
+
+#endif
@@ -0,0 +1,144 @@
+#include "cache.hpp"
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+struct route_key_hash {
+    size_t operator()(const struct route_key &key) const {
+        return key.hash;
+    }
+};
+
+struct route_key_equal {
+    bool operator()(const struct route_key &a, const struct route_key &b) const {
+        return a.start == b.start && a.end == b.end && a.rule == b.rule;
+    }
+};
+
+/* Most recently used first, indexed by key */
+static std::list<route_entry> routes{};
+static std::unordered_map<route_key, std::list<route_entry>::iterator, route_key_hash,
+                          route_key_equal> route_index{};
+
+void route_key_of(struct zgrid *grid, struct connection *con, struct route_key *key) {
+    key->start = (con->start->orig.y / 4) * (int)grid->width + con->start->orig.x / 4;
+    key->end = (con->end->orig.y / 4) * (int)grid->width + con->end->orig.x / 4;
+    key->rule = con->rule;
+    key->hash = ((size_t)(unsigned)key->start * 0x9e3779b97f4a7c15ull) ^
+                ((size_t)(unsigned)key->end << 20) ^ (size_t)key->rule;
+}
+
+static std::list<route_entry>::iterator find(struct route_key *key) {
+    auto it = route_index.find(*key);
+
+    return (it == route_index.end()) ? routes.end() : it->second;
+}
+
+static void drop(std::list<route_entry>::iterator it) {
+    route_index.erase(it->key);
+    routes.erase(it);
+}
+
+/* Cached path of key, if it is still passable. Only the cells next to tiles
+ * whose version moved since the path was cached are checked again. Returns
+ * 1 on a miss, dropping the entry when its path got blocked. */
+int route_cache_get(struct zgrid *grid, struct route_key *key,
+                    const std::function<bool(int x, int y)> &passable,
+                    std::pmr::vector<point> &path, float *bound) {
+    auto it = find(key);
+
+    if (it == routes.end()) {
+        return 1;
+    }
+
+    struct route_entry *entry = &*it;
+    std::vector<unsigned char> changed {};
+
+    /* Filled first, passable() may want the endpoints */
+    path.assign(entry->path.begin(), entry->path.end());
+
+    for (size_t i = 0; i < entry->tiles.size(); i++) {
+        if (grid->blocks[entry->tiles[i]]->version != entry->versions[i]) {
+            changed.resize(grid->nzblocks, 0);
+            changed[entry->tiles[i]] = 1;
+        }
+    }
+
+    if (!changed.empty()) {
+        for (auto &cell : entry->cells) {
+            int bx = (int)(grid_tile(grid, cell.x, cell.y) % grid->nwidth);
+            int by = (int)(grid_tile(grid, cell.x, cell.y) / grid->nwidth);
+            bool near = false;
+
+            for (int y = std::max(by - 1, 0); y <= std::min(by + 1, (int)grid->nheight - 1); y++) {
+                for (int x = std::max(bx - 1, 0); x <= std::min(bx + 1, (int)grid->nwidth - 1); x++) {
+                    near = near || changed[y * grid->nwidth + x];
+                }
+            }
+
+            if (near && !passable(cell.x, cell.y)) {
+                path.clear();
+                drop(it);
+                return 1;
+            }
+        }
+
+        for (size_t i = 0; i < entry->tiles.size(); i++) {
+            entry->versions[i] = grid->blocks[entry->tiles[i]]->version;
+        }
+    }
+
+    routes.splice(routes.begin(), routes, it);
+    *bound = entry->bound;
+
+    return 0;
+}
+
+/* Remember the route committed for key, with the tile versions it leaves */
+void route_cache_put(struct zgrid *grid, struct route_key *key, std::vector<point> &path,
+                     std::vector<point> &cells, float bound) {
+    auto it = find(key);
+
+    if (it == routes.end()) {
+        if (routes.size() >= ROUTE_CACHE_MAX) {
+            drop(std::prev(routes.end()));
+        }
+
+        routes.push_front((struct route_entry) { .key = *key });
+        route_index[*key] = routes.begin();
+    } else {
+        routes.splice(routes.begin(), routes, it);
+    }
+
+    struct route_entry *entry = &routes.front();
+    std::vector<unsigned char> near(grid->nzblocks, 0);
+
+    entry->path = path;
+    entry->cells = cells;
+    entry->bound = bound;
+    entry->tiles.clear();
+    entry->versions.clear();
+
+    for (auto &cell : cells) {
+        int bx = (int)(grid_tile(grid, cell.x, cell.y) % grid->nwidth);
+        int by = (int)(grid_tile(grid, cell.x, cell.y) / grid->nwidth);
+
+        for (int y = std::max(by - 1, 0); y <= std::min(by + 1, (int)grid->nheight - 1); y++) {
+            for (int x = std::max(bx - 1, 0); x <= std::min(bx + 1, (int)grid->nwidth - 1); x++) {
+                near[y * grid->nwidth + x] = 1;
+            }
+        }
+    }
+
+    for (size_t z = 0; z < grid->nzblocks; z++) {
+        if (near[z]) {
+            entry->tiles.push_back(z);
+            entry->versions.push_back(grid->blocks[z]->version);
+        }
+    }
+}
+
+void route_cache_clear(void) {
+    route_index.clear();
+    routes.clear();
+}
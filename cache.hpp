@@ -0,0 +1,47 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <functional>
+#include <memory_resource>
+#include <vector>
+
+#include "grid.hpp"
+#include "route.hpp"
+
+#define ROUTE_CACHE_MAX 64
+
+/* A route is cached for the pads it joins and its net class. Anything else
+ * it depends on is on the board and covered by the tile versions. */
+struct route_key {
+    /* Cells of the start and end pads */
+    int start;
+    int end;
+    int rule;
+    size_t hash;
+};
+
+/* A committed route and the board tiles its path depends on: those under
+ * the path and their neighbours, which clearances reach into */
+struct route_entry {
+    struct route_key key;
+    /* Corners, destination first, as commit_path() takes them */
+    std::vector<point> path;
+    /* Centre line cells, checked again when a tile near them changes */
+    std::vector<point> cells;
+    float bound;
+    std::vector<size_t> tiles;
+    std::vector<unsigned int> versions;
+};
+
+void route_key_of(struct zgrid *grid, struct connection *con, struct route_key *key);
+
+int route_cache_get(struct zgrid *grid, struct route_key *key,
+                    const std::function<bool(int x, int y)> &passable,
+                    std::pmr::vector<point> &path, float *bound);
+
+void route_cache_put(struct zgrid *grid, struct route_key *key, std::vector<point> &path,
+                     std::vector<point> &cells, float bound);
+
+void route_cache_clear(void);
+
+#endif
@@ -0,0 +1,343 @@
+#include "field.hpp"
+#include "arena.hpp"
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <math.h>
+#include <queue>
+#include <utility>
+
+static std::list<lead_field> fields{};
+
+typedef std::pair<float, int> field_entry;
+typedef std::priority_queue<field_entry, std::vector<field_entry>,
+                            std::greater<field_entry>> field_queue;
+
+static int cell_index(struct zgrid *grid, int x, int y) {
+    return y * (int)grid->width + x;
+}
+
+static int cell_blocked(struct lead_field *field, struct zgrid *grid, int x, int y) {
+    int i = cell_index(grid, x, y);
+
+    if (rect_contains(field->escape, x, y)) {
+        return get_node(grid, x, y)->p.obstacle && !field->own[i];
+    }
+
+    return field->clear[i] <= field->reach;
+}
+
+static void build_own(struct lead_field *field, struct zgrid *grid) {
+    std::fill(field->own.begin(), field->own.end(), 0);
+    field->sources.clear();
+
+    for (auto &trace : field->root->traces) {
+        for (auto &line : trace.lines) {
+            field->sources.push_back(cell_index(grid, line.start.x / 4, line.start.y / 4));
+            field->sources.push_back(cell_index(grid, line.end.x / 4, line.end.y / 4));
+
+            for (auto &p : line.obstacle_points) {
+                int i = cell_index(grid, p.x, p.y);
+
+                if (!field->own[i]) {
+                    field->own[i] = 1;
+                    field->sources.push_back(i);
+                }
+            }
+        }
+    }
+
+    field->revision = field->root->revision;
+}
+
+/* Mark the cells of every block whose version moved, and of its neighbours
+ * whose clearances it can reach, plus every cell whose predecessor chain
+ * runs through one of them. A predecessor always is a neighbour, so those
+ * are found walking the predecessor tree down from the marked cells. The
+ * marked cells end up in field->dirty. Returns the number of blocks that
+ * changed. */
+static size_t invalidate(struct lead_field *field, struct zgrid *grid) {
+    size_t changed = 0;
+
+    for (size_t z = 0; z < grid->nzblocks; z++) {
+        changed += field->versions[z] != grid->blocks[z]->version;
+    }
+
+    if (!changed) {
+        return 0;
+    }
+
+    std::vector<unsigned char> redo(grid->nzblocks, 0);
+    std::vector<unsigned char> out {};
+    std::vector<unsigned char> keep {};
+
+    for (size_t z = 0; z < grid->nzblocks; z++) {
+        if (field->versions[z] == grid->blocks[z]->version) {
+            continue;
+        }
+
+        field->versions[z] = grid->blocks[z]->version;
+
+        int bx = z % grid->nwidth;
+        int by = z / grid->nwidth;
+
+        for (int y = std::max(by - 1, 0); y <= std::min(by + 1, (int)grid->nheight - 1); y++) {
+            for (int x = std::max(bx - 1, 0); x <= std::min(bx + 1, (int)grid->nwidth - 1); x++) {
+                redo[y * grid->nwidth + x] = 1;
+            }
+        }
+    }
+
+    for (size_t z = 0; z < grid->nzblocks; z++) {
+        if (!redo[z]) {
+            continue;
+        }
+
+        struct zrect area = block_rect(grid, z);
+
+        if (area.x0 > area.x1 || area.y0 > area.y1) {
+            continue;
+        }
+
+        grid_clearance(grid, area, field->own.data(), out, keep);
+
+        for (int y = area.y0; y <= area.y1; y++) {
+            for (int x = area.x0; x <= area.x1; x++) {
+                int i = cell_index(grid, x, y);
+                int j = (y - area.y0) * (area.x1 - area.x0 + 1) + (x - area.x0);
+
+                field->clear[i] = std::min((int)out[j], keep[j] + field->gap);
+                field->stale[i] = 1;
+                field->dirty.push_back(i);
+            }
+        }
+    }
+
+    for (size_t k = 0; k < field->dirty.size(); k++) {
+        int cur = field->dirty[k];
+        int x = cur % (int)grid->width;
+        int y = cur / (int)grid->width;
+
+        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, (int)grid->height - 1); ny++) {
+            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, (int)grid->width - 1); nx++) {
+                int n = cell_index(grid, nx, ny);
+
+                if (!field->stale[n] && field->pred[n] == cur) {
+                    field->stale[n] = 1;
+                    field->dirty.push_back(n);
+                }
+            }
+        }
+    }
+
+    for (int i : field->dirty) {
+        field->dist[i] = INFINITY;
+        field->pred[i] = -1;
+    }
+
+    return changed;
+}
+
+/* Sources are endpoints and, like search() endpoints, exempt from the rule */
+static void seed(struct lead_field *field, int i, field_queue &queue) {
+    field->dist[i] = 0.f;
+    field->pred[i] = -1;
+    queue.push({0.f, i});
+}
+
+static void field_update(struct lead_field *field, struct zgrid *grid) {
+    size_t ncells = grid->width * grid->height;
+    bool rebuilt_own = false;
+
+    if (field->dist.size() != ncells) {
+        field->dist.assign(ncells, INFINITY);
+        field->pred.assign(ncells, -1);
+        field->own.assign(ncells, 0);
+        field->clear.assign(ncells, CLEARANCE_CAP);
+        field->stale.assign(ncells, 0);
+        field->versions.assign(grid->nzblocks, ~0u);
+        field->revision = field->root->revision - 1;
+    }
+
+    struct point orig = get_node(grid, field->root->orig.x / 4, field->root->orig.y / 4)->p;
+    field->escape = rect_around(grid, &orig, &orig, field->reach + 1);
+
+    if (field->revision != field->root->revision) {
+        build_own(field, grid);
+        rebuilt_own = true;
+    }
+
+    if (!invalidate(field, grid) && !rebuilt_own) {
+        return;
+    }
+
+    field_queue queue{};
+
+    /* Every cell of the net is a source: the pad, the ends of each line and
+     * the copper laid along it, so routes join the nearest trace cell */
+    for (int i : field->sources) {
+        if (field->dist[i] != 0.f) {
+            seed(field, i, queue);
+        }
+    }
+
+    /* Valid cells on the edge of the stale region restart the search */
+    for (size_t k = 0, invalid = field->dirty.size(); k < invalid; k++) {
+        int i = field->dirty[k];
+        int x = i % (int)grid->width;
+        int y = i / (int)grid->width;
+
+        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, (int)grid->height - 1); ny++) {
+            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, (int)grid->width - 1); nx++) {
+                int n = cell_index(grid, nx, ny);
+
+                if (field->stale[n] || field->dist[n] == INFINITY) {
+                    continue;
+                }
+
+                /* Queued once */
+                field->stale[n] = 2;
+                field->dirty.push_back(n);
+                queue.push({field->dist[n], n});
+            }
+        }
+    }
+
+    for (int i : field->dirty) {
+        field->stale[i] = 0;
+    }
+
+    field->dirty.clear();
+
+    while (!queue.empty()) {
+        field_entry top = queue.top();
+        queue.pop();
+
+        if (top.first > field->dist[top.second]) {
+            continue;
+        }
+
+        int x = top.second % (int)grid->width;
+        int y = top.second / (int)grid->width;
+
+        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, (int)grid->height - 1); ny++) {
+            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, (int)grid->width - 1); nx++) {
+                if ((nx == x && ny == y) || cell_blocked(field, grid, nx, ny)) {
+                    continue;
+                }
+
+                int n = cell_index(grid, nx, ny);
+                float dist = top.first + ((nx != x && ny != y) ? (float)M_SQRT2 : 1.f);
+
+                if (dist < field->dist[n]) {
+                    field->dist[n] = dist;
+                    field->pred[n] = top.second;
+                    queue.push({dist, n});
+                }
+            }
+        }
+    }
+}
+
+struct lead_field *field_get(struct zgrid *grid, struct lead *root, struct net_rule *rule) {
+    int reach = rule->width / 2 + rule->clearance;
+    auto it = fields.begin();
+
+    for (; it != fields.end(); it++) {
+        if (it->root == root && it->reach == reach && it->gap == rule->clearance) {
+            break;
+        }
+    }
+
+    if (it == fields.end()) {
+        if (fields.size() >= FIELD_CACHE_MAX) {
+            fields.pop_back();
+        }
+
+        fields.push_front((struct lead_field) {
+            .root = root,
+            .reach = reach,
+            .gap = rule->clearance,
+        });
+    } else {
+        fields.splice(fields.begin(), fields, it);
+    }
+
+    struct lead_field *field = &fields.front();
+    field_update(field, grid);
+
+    return field;
+}
+
+/* The far endpoint usually sits inside the clearance of its own pad: step
+ * out of it breadth first through free cells, as search() would, and join
+ * the field at the best cell reached. */
+static int escape_path(struct lead_field *field, struct zgrid *grid, struct point from,
+                       std::pmr::vector<point> &path, int *joined) {
+    struct zrect zone = rect_around(grid, &from, &from, field->reach + 1);
+    int w = zone.x1 - zone.x0 + 1;
+    std::vector<int> parent((zone.y1 - zone.y0 + 1) * w, -2);
+    std::queue<int> queue {};
+    int best = -1;
+    float best_dist = INFINITY;
+
+    parent[(from.y - zone.y0) * w + (from.x - zone.x0)] = -1;
+    queue.push((from.y - zone.y0) * w + (from.x - zone.x0));
+
+    for (; !queue.empty(); queue.pop()) {
+        int x = zone.x0 + queue.front() % w;
+        int y = zone.y0 + queue.front() / w;
+
+        if (field->dist[cell_index(grid, x, y)] < best_dist) {
+            best_dist = field->dist[cell_index(grid, x, y)];
+            best = queue.front();
+        }
+
+        for (int ny = std::max(y - 1, zone.y0); ny <= std::min(y + 1, zone.y1); ny++) {
+            for (int nx = std::max(x - 1, zone.x0); nx <= std::min(x + 1, zone.x1); nx++) {
+                int n = (ny - zone.y0) * w + (nx - zone.x0);
+
+                if (parent[n] != -2 || get_node(grid, nx, ny)->p.obstacle) {
+                    continue;
+                }
+
+                parent[n] = queue.front();
+                queue.push(n);
+            }
+        }
+    }
+
+    if (best < 0) {
+        return 1;
+    }
+
+    std::pmr::vector<point> steps {route_arena()};
+
+    for (int i = parent[best]; i >= 0; i = parent[i]) {
+        steps.push_back(get_node(grid, zone.x0 + i % w, zone.y0 + i / w)->p);
+    }
+
+    path.insert(path.end(), steps.rbegin(), steps.rend());
+    *joined = cell_index(grid, zone.x0 + best % w, zone.y0 + best / w);
+
+    return 0;
+}
+
+int field_path(struct lead_field *field, struct zgrid *grid, struct point from,
+               std::pmr::vector<point> &path) {
+    int i = cell_index(grid, from.x, from.y);
+
+    if (field->dist[i] == INFINITY && escape_path(field, grid, from, path, &i)) {
+        return 1;
+    }
+
+    for (; i >= 0; i = field->pred[i]) {
+        path.push_back(get_node(grid, i % (int)grid->width, i / (int)grid->width)->p);
+    }
+
+    return 0;
+}
+
+void field_cache_clear(void) {
+    fields.clear();
+}
@@ -0,0 +1,47 @@
+#ifndef FIELD_HPP
+#define FIELD_HPP
+
+#include <vector>
+
+#include "grid.hpp"
+#include "route.hpp"
+
+#define FIELD_CACHE_MAX 8
+
+/* Distance/predecessor field rooted at every cell of a lead's net.
+ * Fields are repaired tile by tile against the zblock versions they were
+ * computed for, so a backtrace from any cell is a route to the net. */
+struct lead_field {
+    struct lead *root;
+    /* Half trace width plus clearance of the net class the field is for */
+    int reach;
+    /* Clearance alone, other copper keeps the larger of it and its own */
+    int gap;
+    /* Around the root pad only real obstacles block, see passable() */
+    struct zrect escape;
+    /* Root revision the own mask was built for */
+    unsigned int revision;
+
+    std::vector<float> dist;
+    std::vector<int> pred;
+    /* Cells covered by the root's own traces, passable for the field */
+    std::vector<unsigned char> own;
+    /* Own cells and line ends, the cells every route may join */
+    std::vector<int> sources;
+    /* Clearances with the root's own traces left out, see rule_clearance() */
+    std::vector<unsigned char> clear;
+    std::vector<unsigned int> versions;
+    /* Cells invalidated by the current update and their flags, cleared
+     * again before it returns */
+    std::vector<int> dirty;
+    std::vector<unsigned char> stale;
+};
+
+struct lead_field *field_get(struct zgrid *grid, struct lead *root, struct net_rule *rule);
+
+int field_path(struct lead_field *field, struct zgrid *grid, struct point from,
+               std::pmr::vector<point> &path);
+
+void field_cache_clear(void);
+
+#endif
@@ -9,46 +9,183 @@
 
 #include "raylib.h"
 
+/* Source of tile versions, see struct zblock */
+static unsigned int tile_stamp = 0;
+
+static void release_block(struct zblock *block) {
+    if (--block->refs == 0) {
+        delete block;
+    }
+}
+
 void delete_zgrid(struct zgrid *grid) {
+    for (size_t z = 0; z < grid->nzblocks; z++) {
+        release_block(grid->blocks[z]);
+    }
+
     delete[] grid->blocks;
 }
 
+/* Snapshot grid into new_grid: both hold the same tiles until one of them
+ * writes to a tile through grid_block_w() */
 int grid_copy(struct zgrid *grid, struct zgrid *new_grid) {
   *new_grid = *grid;
-  new_grid->blocks = new zblock[new_grid->nzblocks];
+  new_grid->blocks = new zblock *[new_grid->nzblocks];
 
   if (!new_grid->blocks) {
     return 1;
   }
   
   for (size_t i = 0; i < grid->nzblocks; i++) {
-    std::copy(std::begin(grid->blocks[i].nodes), std::end(grid->blocks[i].nodes), std::begin(new_grid->blocks[i].nodes));
+    new_grid->blocks[i] = grid->blocks[i];
+    new_grid->blocks[i]->refs++;
   }
 
   return 0;
 }
 
+/* Make grid a snapshot of src again, dropping the tiles it cloned since */
+void grid_share(struct zgrid *grid, struct zgrid *src) {
+  for (size_t i = 0; i < grid->nzblocks; i++) {
+    if (grid->blocks[i] == src->blocks[i]) {
+      continue;
+    }
+
+    src->blocks[i]->refs++;
+    release_block(grid->blocks[i]);
+    grid->blocks[i] = src->blocks[i];
+  }
+}
+
+/* Writable tile z, cloned first when another grid holds it. Node pointers
+ * into an owned tile stay valid until the grid shares it again. */
+struct zblock *grid_block_w(struct zgrid *grid, size_t z) {
+    struct zblock *block = grid->blocks[z];
+
+    if (block->refs > 1) {
+        struct zblock *copy = new zblock(*block);
+
+        copy->refs = 1;
+        block->refs--;
+        grid->blocks[z] = copy;
+
+        return copy;
+    }
+
+    return block;
+}
+
+struct node *get_node_w(struct zgrid *grid, int x, int y) {
+    x += HALO_WIDTH;
+    y += HALO_WIDTH;
+
+    struct zblock *block = grid_block_w(grid, (x/ZWIDTH) + (y/ZHEIGHT) * grid->nwidth);
+    return &block->nodes[(x % ZWIDTH) + (y % ZHEIGHT) * ZWIDTH];
+}
+
+/* Index of the block holding cell (x, y) */
+size_t grid_tile(struct zgrid *grid, int x, int y) {
+    return ((x + HALO_WIDTH) / ZWIDTH) + ((y + HALO_WIDTH) / ZHEIGHT) * grid->nwidth;
+}
+
+/* Inclusive rectangle of block coordinates covering the cells of area */
+struct zrect tile_span(struct zrect area) {
+    return (struct zrect) {
+        .x0 = (area.x0 + HALO_WIDTH) / ZWIDTH,
+        .y0 = (area.y0 + HALO_WIDTH) / ZHEIGHT,
+        .x1 = (area.x1 + HALO_WIDTH) / ZWIDTH,
+        .y1 = (area.y1 + HALO_WIDTH) / ZHEIGHT,
+    };
+}
+
+/* Own every tile area touches, so plain get_node() writes inside it are safe */
+void grid_own_area(struct zgrid *grid, struct zrect area) {
+    struct zrect span = tile_span(area);
+
+    for (int y = span.y0; y <= span.y1; y++) {
+        for (int x = span.x0; x <= span.x1; x++) {
+            grid_block_w(grid, x + y * grid->nwidth);
+        }
+    }
+}
+
+/* The 8 neighbours of a board cell, in the lane order of relax_kernel().
+ * Inside a block they are plain offsets from node. */
+void grid_neighbours(struct zgrid *grid, struct node *node, struct node *out[8]) {
+    static const int dx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+    static const int dy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+    int bx = (node->p.x + HALO_WIDTH) % ZWIDTH;
+    int by = (node->p.y + HALO_WIDTH) % ZHEIGHT;
+
+    if (bx > 0 && bx < ZWIDTH - 1 && by > 0 && by < ZHEIGHT - 1) {
+        for (int k = 0; k < 8; k++) {
+            out[k] = node + dx[k] + dy[k] * ZWIDTH;
+        }
+
+        return;
+    }
+
+    for (int k = 0; k < 8; k++) {
+        out[k] = get_node(grid, node->p.x + dx[k], node->p.y + dy[k]);
+    }
+}
+
+/* Close the ring of board cells around area, so a search confined to area
+ * needs no bounds checks either. The ring must be owned, see grid_reset_area(). */
+void grid_fence(struct zgrid *grid, struct zrect area) {
+  struct zrect ring = rect_grow(grid, area, 1);
+
+  for (int y = ring.y0; y <= ring.y1; y++) {
+    for (int x = ring.x0; x <= ring.x1; x++) {
+      if (rect_contains(area, x, y)) {
+        x = area.x1;
+        continue;
+      }
+
+      struct node *node = get_node(grid, x, y);
+      node->visited = NODE_FENCE;
+      node->distance = INFINITY;
+    }
+  }
+}
+
 void create_zgrid(struct zgrid *grid) {
-    size_t nzblocks = align_div(grid->width, ZWIDTH) * align_div(grid->height, ZHEIGHT);
+    size_t nzblocks = align_div(grid->width + 2 * HALO_WIDTH, ZWIDTH) *
+                      align_div(grid->height + 2 * HALO_WIDTH, ZHEIGHT);
 
-    grid->blocks = new zblock[nzblocks];
+    grid->blocks = new zblock *[nzblocks];
 
-    grid->nwidth = align_div(grid->width, ZWIDTH);
-    grid->nheight = align_div(grid->height, ZHEIGHT);
+    grid->nwidth = align_div(grid->width + 2 * HALO_WIDTH, ZWIDTH);
+    grid->nheight = align_div(grid->height + 2 * HALO_WIDTH, ZHEIGHT);
     grid->nzblocks = grid->nwidth * grid->nheight;
 
     for (int z = 0; z < nzblocks; z++) {
+        struct zblock *block = new zblock;
+
+        block->version = 0;
+        block->clear_version = 0;
+        block->refs = 1;
+        grid->blocks[z] = block;
+
         for (int i = 0; i < ZWIDTH * ZHEIGHT; i++) {
             struct point p = (struct point) {
-              .x = (int)((i % ZWIDTH) + ((z % grid->nwidth) * ZWIDTH)),
-              .y = (int)((i / ZWIDTH) + ((z / grid->nwidth) * ZHEIGHT)),
+              .x = (int)((i % ZWIDTH) + ((z % grid->nwidth) * ZWIDTH)) - HALO_WIDTH,
+              .y = (int)((i / ZWIDTH) + ((z / grid->nwidth) * ZHEIGHT)) - HALO_WIDTH,
                 .obstacle = NIL,
             };
+            bool halo = p.x < 0 || p.x >= (int)grid->width || p.y < 0 || p.y >= (int)grid->height;
 
-            grid->blocks[z].nodes[i] = (struct node) {
+            if (halo) {
+                p.obstacle = HALO;
+            }
+
+            block->nodes[i] = (struct node) {
                 .p = p,
                 .distance = INFINITY,
                 .visited = true,
+                .clearance = (unsigned char)(halo ? 0 : CLEARANCE_CAP),
+                .keepout = (unsigned char)(halo ? 0 : CLEARANCE_CAP),
+                .gap = 0,
             };
                 
         }
@@ -56,10 +193,247 @@ void create_zgrid(struct zgrid *grid) {
 }
 
 struct node *get_node(struct zgrid *grid, int x, int y) {
-    struct zblock *block = &grid->blocks[(x/ZWIDTH) + (y/ZHEIGHT) * (align_div(grid->width, ZWIDTH))];
+    x += HALO_WIDTH;
+    y += HALO_WIDTH;
+
+    struct zblock *block = grid->blocks[(x/ZWIDTH) + (y/ZHEIGHT) * grid->nwidth];
     return &block->nodes[(x % ZWIDTH) + (y % ZHEIGHT) * ZWIDTH];
 }
 
+struct zrect grid_rect(struct zgrid *grid) {
+  return (struct zrect) {
+    .x0 = 0,
+    .y0 = 0,
+    .x1 = (int)grid->width - 1,
+    .y1 = (int)grid->height - 1,
+  };
+}
+
+struct zrect rect_grow(struct zgrid *grid, struct zrect rect, int margin) {
+  return (struct zrect) {
+    .x0 = std::max(rect.x0 - margin, 0),
+    .y0 = std::max(rect.y0 - margin, 0),
+    .x1 = std::min(rect.x1 + margin, (int)grid->width - 1),
+    .y1 = std::min(rect.y1 + margin, (int)grid->height - 1),
+  };
+}
+
+struct zrect rect_around(struct zgrid *grid, struct point *a, struct point *b, int margin) {
+  struct zrect bbox = {
+    .x0 = std::min(a->x, b->x),
+    .y0 = std::min(a->y, b->y),
+    .x1 = std::max(a->x, b->x),
+    .y1 = std::max(a->y, b->y),
+  };
+
+  return rect_grow(grid, bbox, margin);
+}
+
+int rect_contains(struct zrect rect, int x, int y) {
+  return x >= rect.x0 && x <= rect.x1 && y >= rect.y0 && y <= rect.y1;
+}
+
+int rect_equal(struct zrect a, struct zrect b) {
+  return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+
+/* Clear the search state of every node in area, leaving the nodes inside
+ * keep (if any) untouched so a widened search can reuse them. The tiles of
+ * area end up owned by grid, the search writes to them freely. */
+void grid_reset_area(struct zgrid *grid, struct zrect area, struct zrect *keep) {
+  grid_own_area(grid, area);
+
+  for (int y = area.y0; y <= area.y1; y++) {
+    for (int x = area.x0; x <= area.x1; x++) {
+      if (keep && rect_contains(*keep, x, y)) {
+        continue;
+      }
+
+      struct node *node = get_node(grid, x, y);
+      node->visited = false;
+      node->distance = INFINITY;
+    }
+  }
+}
+
+struct zblock *get_block(struct zgrid *grid, int x, int y) {
+    return grid->blocks[grid_tile(grid, x, y)];
+}
+
+void grid_set_obstacle(struct zgrid *grid, int x, int y, OBSTACLE obstacle, int gap) {
+    struct node *node = get_node(grid, x, y);
+
+    if (!obstacle) {
+        gap = 0;
+    }
+
+    if (node->p.obstacle == obstacle && node->gap == gap) {
+        return;
+    }
+
+    node = get_node_w(grid, x, y);
+    node->p.obstacle = obstacle;
+    node->gap = gap;
+    get_block(grid, x, y)->version = ++tile_stamp;
+}
+
+/* Board cells of block z, empty (x0 > x1 or y0 > y1) for a block of halo */
+struct zrect block_rect(struct zgrid *grid, size_t z) {
+  int x = (z % grid->nwidth) * ZWIDTH - HALO_WIDTH;
+  int y = (z / grid->nwidth) * ZHEIGHT - HALO_WIDTH;
+
+  return (struct zrect) {
+    .x0 = std::max(x, 0),
+    .y0 = std::max(y, 0),
+    .x1 = std::min(x + ZWIDTH, (int)grid->width) - 1,
+    .y1 = std::min(y + ZHEIGHT, (int)grid->height) - 1,
+  };
+}
+
+/* Two-pass chessboard distance transform of the w * h cells of dt */
+static void chessboard(std::vector<int> &dt, int w, int h) {
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      int i = y * w + x;
+      int d = dt[i];
+
+      if (x > 0) d = std::min(d, dt[i - 1] + 1);
+      if (y > 0) {
+        d = std::min(d, dt[i - w] + 1);
+        if (x > 0) d = std::min(d, dt[i - w - 1] + 1);
+        if (x < w - 1) d = std::min(d, dt[i - w + 1] + 1);
+      }
+
+      dt[i] = d;
+    }
+  }
+
+  for (int y = h - 1; y >= 0; y--) {
+    for (int x = w - 1; x >= 0; x--) {
+      int i = y * w + x;
+      int d = dt[i];
+
+      if (x < w - 1) d = std::min(d, dt[i + 1] + 1);
+      if (y < h - 1) {
+        d = std::min(d, dt[i + w] + 1);
+        if (x < w - 1) d = std::min(d, dt[i + w + 1] + 1);
+        if (x > 0) d = std::min(d, dt[i + w - 1] + 1);
+      }
+
+      dt[i] = d;
+    }
+  }
+}
+
+/* Chessboard distance transform of area, capped at CLEARANCE_CAP. Obstacles
+ * on cells flagged in ignore (indexed y * width + x) don't count. out and
+ * keep are filled row by row with the clearance and keepout of every cell
+ * of area. */
+void grid_clearance(struct zgrid *grid, struct zrect area, const unsigned char *ignore,
+                    std::vector<unsigned char> &out, std::vector<unsigned char> &keep) {
+  struct zrect src = rect_grow(grid, area, CLEARANCE_CAP);
+  int w = src.x1 - src.x0 + 1;
+  int h = src.y1 - src.y0 + 1;
+  std::vector<int> dt(w * h);
+  std::vector<int> kt(w * h);
+
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      int gx = src.x0 + x;
+      int gy = src.y0 + y;
+      struct node *node = get_node(grid, gx, gy);
+      bool blocked = node->p.obstacle && !(ignore && ignore[gy * grid->width + gx]);
+
+      dt[y * w + x] = blocked ? 0 : CLEARANCE_CAP;
+      kt[y * w + x] = blocked ? -node->gap : CLEARANCE_CAP;
+    }
+  }
+
+  chessboard(dt, w, h);
+  chessboard(kt, w, h);
+
+  out.resize((area.x1 - area.x0 + 1) * (area.y1 - area.y0 + 1));
+  keep.resize(out.size());
+
+  for (int y = area.y0; y <= area.y1; y++) {
+    for (int x = area.x0; x <= area.x1; x++) {
+      int i = (y - area.y0) * (area.x1 - area.x0 + 1) + (x - area.x0);
+      int j = (y - src.y0) * w + (x - src.x0);
+
+      out[i] = dt[j];
+      keep[i] = std::max(kt[j], 0);
+    }
+  }
+}
+
+/* Recompute the clearances of every block whose obstacles changed since the
+ * last update, along with its neighbours, which the change can reach. */
+void grid_update_clearance(struct zgrid *grid) {
+  std::vector<unsigned char> redo(grid->nzblocks, 0);
+  std::vector<unsigned char> out {};
+  std::vector<unsigned char> keep {};
+
+  for (size_t z = 0; z < grid->nzblocks; z++) {
+    struct zblock *block = grid->blocks[z];
+
+    if (block->version == block->clear_version) {
+      continue;
+    }
+
+    grid_block_w(grid, z)->clear_version = block->version;
+
+    int bx = z % grid->nwidth;
+    int by = z / grid->nwidth;
+
+    for (int y = std::max(by - 1, 0); y <= std::min(by + 1, (int)grid->nheight - 1); y++) {
+      for (int x = std::max(bx - 1, 0); x <= std::min(bx + 1, (int)grid->nwidth - 1); x++) {
+        redo[y * grid->nwidth + x] = 1;
+      }
+    }
+  }
+
+  for (size_t z = 0; z < grid->nzblocks; z++) {
+    if (!redo[z]) {
+      continue;
+    }
+
+    struct zrect area = block_rect(grid, z);
+    bool same = true;
+
+    if (area.x0 > area.x1 || area.y0 > area.y1) {
+      continue;
+    }
+
+    grid_clearance(grid, area, NULL, out, keep);
+
+    for (int y = area.y0; y <= area.y1 && same; y++) {
+      for (int x = area.x0; x <= area.x1 && same; x++) {
+        int i = (y - area.y0) * (area.x1 - area.x0 + 1) + (x - area.x0);
+
+        struct node *node = get_node(grid, x, y);
+
+        same = node->clearance == out[i] && node->keepout == keep[i];
+      }
+    }
+
+    /* Leave unchanged tiles shared with the snapshots that hold them */
+    if (same) {
+      continue;
+    }
+
+    grid_block_w(grid, z);
+
+    for (int y = area.y0; y <= area.y1; y++) {
+      for (int x = area.x0; x <= area.x1; x++) {
+        int i = (y - area.y0) * (area.x1 - area.x0 + 1) + (x - area.x0);
+
+        get_node(grid, x, y)->clearance = out[i];
+        get_node(grid, x, y)->keepout = keep[i];
+      }
+    }
+  }
+}
+
 vec2 scale_vec(vec2 vec) {
   return {
     vec.x / 4,
@@ -5,8 +5,19 @@
 #define ZHEIGHT 16
 #define BLOCK_SIZE (ZWIDTH * ZHEIGHT)
 
+/* Largest clearance tracked per node, must not exceed ZWIDTH/ZHEIGHT */
+#define CLEARANCE_CAP 8
+
+/* Cells of permanent HALO obstacles around the board, so that neighbour
+ * loops can step off any board cell without bounds checks */
+#define HALO_WIDTH 1
+
+/* node.visited of the closed ring grid_fence() puts around a search window */
+#define NODE_FENCE -1
+
 #include <stdint.h>
 #include <stddef.h>
+#include <vector>
 #include "raylib.h"
 
 #define align_div(x, div) (((x) / (div)) + (((x) % (div)) ? 1 : 0))
@@ -16,6 +27,8 @@ typedef enum {
     LINE = 1,
     LEAD = 2,
     VIA = 3,
+    /* Board edge, never cleared and ignored by the clearance transform */
+    HALO = 4,
 } OBSTACLE;
 
 struct point {
@@ -44,12 +57,39 @@ struct node {
     struct point p;
     float distance;
     int visited;
+    /* Chessboard distance to the nearest obstacle, capped at CLEARANCE_CAP */
+    unsigned char clearance;
+    /* Same, less the gap of the nearest copper and floored at 0: copper of
+     * a net class with a wider gap keeps it from every other net */
+    unsigned char keepout;
+    /* Gap the copper on the cell keeps to other nets, 0 for pads */
+    unsigned char gap;
 };
 
+/* Tiles are shared between grid snapshots and cloned on the first write
+ * through grid_block_w(), so a snapshot costs one pointer per tile. */
 struct zblock {
     struct node nodes[BLOCK_SIZE];
+    /* Restamped on every obstacle change inside the block, stamps are never
+     * reused so equal versions mean equal obstacles across snapshots too */
+    unsigned int version;
+    /* Version the clearances of the block were last computed for */
+    unsigned int clear_version;
+    /* Number of grids holding the tile */
+    unsigned int refs;
 };
 
+/* Inclusive cell rectangle, used to confine a search to a corridor. */
+struct zrect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+/* width and height are the board in cells, the blocks also hold the halo:
+ * cell (x, y) is stored at (x + HALO_WIDTH, y + HALO_WIDTH), so get_node()
+ * is valid from -HALO_WIDTH to width - 1 + HALO_WIDTH. */
 struct zgrid {
     size_t nzblocks;
     size_t nwidth;
@@ -58,12 +98,12 @@ struct zgrid {
     size_t width;
     size_t height;
 
-    struct zblock *blocks;
+    struct zblock **blocks;
 };
 
 #define grid_foreach(node, grid)         \
-    struct node *node = grid->blocks[0].nodes;                          \
-    for (int i = 0; i < grid->nzblocks * BLOCK_SIZE; i++, node = &grid->blocks[i / BLOCK_SIZE].nodes[i % BLOCK_SIZE])
+    struct node *node = grid->blocks[0]->nodes;                         \
+    for (int i = 0; i < grid->nzblocks * BLOCK_SIZE; i++, node = &grid->blocks[i / BLOCK_SIZE]->nodes[i % BLOCK_SIZE])
 
 
 struct node *get_node(struct zgrid *grid, int x, int y);
@@ -80,4 +120,43 @@ vec2 scale_vec(vec2 vec);
 
 int grid_copy(struct zgrid *grid, struct zgrid *new_grid);
 
+void grid_share(struct zgrid *grid, struct zgrid *src);
+
+struct zblock *get_block(struct zgrid *grid, int x, int y);
+
+struct zblock *grid_block_w(struct zgrid *grid, size_t z);
+
+struct node *get_node_w(struct zgrid *grid, int x, int y);
+
+void grid_own_area(struct zgrid *grid, struct zrect area);
+
+size_t grid_tile(struct zgrid *grid, int x, int y);
+
+struct zrect tile_span(struct zrect area);
+
+void grid_neighbours(struct zgrid *grid, struct node *node, struct node *out[8]);
+
+void grid_fence(struct zgrid *grid, struct zrect area);
+
+void grid_set_obstacle(struct zgrid *grid, int x, int y, OBSTACLE obstacle, int gap);
+
+struct zrect grid_rect(struct zgrid *grid);
+
+struct zrect rect_around(struct zgrid *grid, struct point *a, struct point *b, int margin);
+
+struct zrect rect_grow(struct zgrid *grid, struct zrect rect, int margin);
+
+int rect_contains(struct zrect rect, int x, int y);
+
+int rect_equal(struct zrect a, struct zrect b);
+
+void grid_reset_area(struct zgrid *grid, struct zrect area, struct zrect *keep);
+
+struct zrect block_rect(struct zgrid *grid, size_t z);
+
+void grid_clearance(struct zgrid *grid, struct zrect area, const unsigned char *ignore,
+                    std::vector<unsigned char> &out, std::vector<unsigned char> &keep);
+
+void grid_update_clearance(struct zgrid *grid);
+
 #endif
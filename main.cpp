@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <iterator>
 #include <math.h>
@@ -5,17 +6,29 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
 
+#include "arena.hpp"
+#include "bucket.hpp"
+#include "cache.hpp"
+#include "field.hpp"
+#include "overlay.hpp"
+#include "relax.hpp"
 #include "grid.hpp"
+#include "route.hpp"
+#include "server.hpp"
+#include "session.hpp"
 #include "raylib.h"
 #include "raymath.h"
 #include "rlgl.h"
+#include <deque>
 #include <queue>
+#include <unordered_map>
 #include <vector>
 
 #define GRID_WIDTH 320
@@ -32,32 +45,6 @@ Camera2D camera;
 
 typedef struct vec2 vec2;
 
-struct line {
-    vec2 start;
-    vec2 end;
-    std::vector<point> obstacle_points;
-};
-
-struct connection;
-struct trace;
-
-struct lead {
-  struct vec2 orig;
-  int width; 
-  int height;
-  std::vector<trace> traces;
-};
-
-struct trace {
-  std::vector<line> lines{};
-  struct connection *con;
-};
-
-struct connection {
-  struct lead *start;
-  struct lead *end;
-};
-
 struct grid {
   size_t width;
   size_t height;
@@ -65,8 +52,34 @@ struct grid {
 };
 
 static std::vector<trace> traces{};
-static std::vector<lead> leads{};
+static std::deque<lead> leads{};
 static std::vector<connection> connections{};
+/* Every connection routed so far, traces point into it */
+static std::deque<connection> nets{};
+
+struct route_options route_opts = {
+    .field_cache = true,
+    .hub_connections = 3,
+    .pad_width = 3,
+    .any_angle = false,
+    .integer_costs = true,
+    .anytime = false,
+    .anytime_weight = 2.f,
+    .anytime_ms = 20.f,
+    .anytime_expansions = 0,
+    .route_cache = true,
+};
+
+std::vector<net_rule> net_rules = {
+    {.width = 3, .clearance = 0},
+    {.width = 5, .clearance = 1},
+    {.width = 7, .clearance = 2},
+};
+
+/* Cells a trace of the rule keeps free around its centre line */
+int rule_reach(struct net_rule *rule) {
+    return rule->width / 2 + rule->clearance;
+}
 
 float euclid_distance(struct point *a, struct point *b) {
     if (a->x == b->x) {
@@ -81,105 +94,480 @@ float euclid_distance(struct point *a, struct point *b) {
     }
 }
 
-void draw_path(connection *con, node *first, node *dest, zgrid *grid, zgrid *work_grid) {
-    struct node *current = dest;
-    int last_x = dest->p.x;
-    int last_y = dest->p.y;
+/* Clearance of node as seen by a trace of rule, which keeps the larger of
+ * its own gap and that of the copper it passes: compared with reach, this
+ * is node->clearance > reach and node->keepout > half the trace width. */
+int rule_clearance(struct node *node, struct net_rule *rule) {
+    return std::min((int)node->clearance, node->keepout + rule->clearance);
+}
 
-    struct vec2 prev_vec {};
-    struct vec2 prev_pos = {last_x, last_y};
+/* A node is passable when its clearance exceeds reach, the half trace width
+ * plus clearance of the net class being routed. Endpoints usually sit right
+ * next to their own pad, so within reach + 1 cells of one only real
+ * obstacles block; the destination itself always is passable. */
+int passable(struct node *node, struct node *first, struct node *dest, struct net_rule *rule) {
+    int reach = rule_reach(rule);
 
-    struct lead depart = {
-        .orig = {scalex(first->p.x), scaley(first->p.y)},
-        .width = 10,
-        .height = 10,
-    };
+    if (node == dest || rule_clearance(node, rule) > reach) {
+        return 1;
+    }
 
-    struct lead last = {
-        .orig = {scalex(dest->p.x), scaley(dest->p.y)},
-        .width = 10,
-        .height = 10,
-    };
+    if (node->p.obstacle) {
+        return 0;
+    }
 
-    // leads.push_back(depart);
-    // leads.push_back(last);
-    std::vector<point> obstacle_points {};
-    std::vector<line> lines {};
-    unsigned int cnt = 0;
+    return std::max(abs(node->p.x - first->p.x), abs(node->p.y - first->p.y)) <= reach + 1 ||
+           std::max(abs(node->p.x - dest->p.x), abs(node->p.y - dest->p.y)) <= reach + 1;
+}
+
+/* Walk the searched work grid back from dest to first, always stepping to
+ * the closest visited neighbour. Returns 1 if first can't be reached. */
+int backtrace(struct node *first, struct node *dest, struct zgrid *work_grid,
+              std::pmr::vector<point> &path) {
+    struct node *current = dest;
+
+    path.push_back(current->p);
 
     while (current != first) {
         struct node *next = NULL; // 
         float next_dist = INFINITY;
 
-        for (int y = (current->p.y ? -1 : 0);
-             y <= ((current->p.y >= grid->height - 1) ? 0 : 1); y++) {
-            for (int x = (current->p.x ? -1 : 0);
-                 x <= ((current->p.x >= grid->width - 1) ? 0 : 1); x++) {
-                struct node *node =
-                    get_node(grid, current->p.x + x, current->p.y + y);
+        struct node *around[8];
+        grid_neighbours(work_grid, current, around);
 
-                struct node *work_node = get_node(work_grid, current->p.x + x, current->p.y + y);
+        /* The halo is an obstacle, no need to check the board bounds */
+        for (struct node *work_node : around) {
+            if (work_node->p.obstacle)
+                continue;
 
-                if (work_node->p.obstacle)
-                    continue;
+            if (!work_node->visited) {
+                continue;
+            }
 
-                node->p.obstacle = LINE;
-                obstacle_points.push_back(node->p);
-                /* DrawRectangle(scalex(node->p.x), scaley(node->p.y), 1, 1,
-                 * GREEN); */
+            float dist = work_node->distance;
 
-                if (!work_node->visited || work_node == current) {
-                    continue;
-                }
+            if (dist < next_dist) {
+                next_dist = dist;
+                next = work_node;
+            }
+        }
 
-                float dist = work_node->distance;
+        /* Distances only drop towards first, anything else would cycle */
+        if (!next || next_dist >= current->distance) {
+            return 1;
+        }
 
-                if (dist < next_dist) {
-                    next_dist = dist;
-                    next = work_node;
-                }
+        current = next;
+        path.push_back(current->p);
+    }
+
+    return 0;
+}
+
+/* Call fn for every cell of the segment a-b, both ends included */
+template <typename F>
+int walk_segment(struct point a, struct point b, F fn) {
+    int steps = std::max(abs(b.x - a.x), abs(b.y - a.y));
+
+    for (int i = 0; i <= steps; i++) {
+        int x = a.x + (steps ? (int)lroundf((float)(b.x - a.x) * i / steps) : 0);
+        int y = a.y + (steps ? (int)lroundf((float)(b.y - a.y) * i / steps) : 0);
+
+        if (fn(x, y)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+#define SIMPLIFY_LOOKAHEAD 64
+/* Corners the second pass tries to bridge with a single elbow */
+#define SIMPLIFY_MERGE 8
+
+/* Reduce a cell path to the corners of a minimal polyline: from every corner
+ * pull the string to the farthest later path cell still in line of sight,
+ * then replace runs of short jogs, typically left where the path leaves a
+ * pad, by the shortest elbow that still passes. Unless route_opts.any_angle
+ * is set, segments stay at multiples of 45 degrees. The corners run from
+ * the first path cell to the last. */
+void simplify_path(std::pmr::vector<point> &path, struct zgrid *work_grid, struct net_rule *rule,
+                   std::pmr::vector<point> &corners) {
+    struct node *first = get_node(work_grid, path.back().x, path.back().y);
+    struct node *dest = get_node(work_grid, path.front().x, path.front().y);
+
+    auto blocked = [&](int x, int y) {
+        return !passable(get_node(work_grid, x, y), first, dest, rule);
+    };
+
+    size_t anchor = 0;
+    corners.push_back(path[0]);
+
+    while (anchor < path.size() - 1) {
+        size_t best = anchor + 1;
+        int misses = 0;
+
+        for (size_t j = anchor + 2; j < path.size() && misses < SIMPLIFY_LOOKAHEAD; j++) {
+            int dx = abs(path[j].x - path[anchor].x);
+            int dy = abs(path[j].y - path[anchor].y);
+
+            if (!route_opts.any_angle && dx && dy && dx != dy) {
+                misses++;
+                continue;
+            }
+
+            if (walk_segment(path[anchor], path[j], blocked)) {
+                break;
             }
+
+            best = j;
+            misses = 0;
         }
 
-        if (!next) {
+        corners.push_back(path[best]);
+        anchor = best;
+    }
+
+    /* Straight-then-diagonal or diagonal-then-straight from a to c, middle
+     * corner in m (equal to a when one segment does). Returns 1 if neither
+     * passes. */
+    auto elbow = [&](struct point a, struct point c, struct point *m) {
+        int dx = c.x - a.x;
+        int dy = c.y - a.y;
+        int d = std::min(abs(dx), abs(dy));
+
+        if ((route_opts.any_angle || !dx || !dy || abs(dx) == abs(dy)) &&
+            !walk_segment(a, c, blocked)) {
+            *m = a;
+            return 0;
+        }
+
+        if (route_opts.any_angle) {
+            return 1;
+        }
+
+        struct point diagonal_first = {a.x + (dx > 0 ? d : -d), a.y + (dy > 0 ? d : -d)};
+        struct point straight_first = {c.x - (dx > 0 ? d : -d), c.y - (dy > 0 ? d : -d)};
+
+        for (struct point mid : {diagonal_first, straight_first}) {
+            if (!walk_segment(a, mid, blocked) && !walk_segment(mid, c, blocked)) {
+                *m = mid;
+                return 0;
+            }
+        }
+
+        return 1;
+    };
+
+    for (size_t i = 0; i + 2 < corners.size(); i++) {
+        for (size_t k = std::min(corners.size() - 1, i + SIMPLIFY_MERGE); k >= i + 2; k--) {
+            struct point m;
+
+            if (elbow(corners[i], corners[k], &m)) {
+                continue;
+            }
+
+            bool straight = m.x == corners[i].x && m.y == corners[i].y;
+
+            /* Only when it saves a corner */
+            if (!straight && k == i + 2) {
+                continue;
+            }
+
+            corners.erase(corners.begin() + i + 1, corners.begin() + k);
+
+            if (!straight) {
+                corners.insert(corners.begin() + i + 1, m);
+            }
+
             break;
         }
+    }
+
+    /* Drop the corners left in the middle of a straight run */
+    for (size_t i = 1; i + 1 < corners.size();) {
+        struct point a = corners[i - 1];
+        struct point b = corners[i];
+        struct point c = corners[i + 1];
+
+        if ((b.x - a.x) * (c.y - b.y) == (b.y - a.y) * (c.x - b.x) &&
+            !walk_segment(a, c, blocked)) {
+            corners.erase(corners.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+/* Committed connections that pass through every zblock, so that an edit only
+ * has to look at the traces in the tiles it touches */
+static std::vector<std::vector<connection *>> tile_nets{};
+/* Connections whose traces end on the copper of a connection's trace. They
+ * only reach their lead through it, so they go when it goes. */
+static std::unordered_map<connection *, std::vector<connection *>> trace_feeds{};
+
+struct trace *find_trace(struct connection *con) {
+    for (auto &trace : traces) {
+        if (trace.con == con) {
+            return &trace;
+        }
+    }
+
+    return NULL;
+}
+
+void track_trace(struct zgrid *grid, struct trace *trace) {
+    tile_nets.resize(grid->nzblocks);
+
+    for (auto &line : trace->lines) {
+        for (auto &p : line.obstacle_points) {
+            auto &nets = tile_nets[grid_tile(grid, p.x, p.y)];
+
+            if (std::find(nets.begin(), nets.end(), trace->con) == nets.end()) {
+                nets.push_back(trace->con);
+            }
+        }
+    }
+}
 
-        cnt++;
+/* Record that the trace of con ends on the copper of the traces found at the
+ * cells its endpoints land on */
+void track_feeds(struct zgrid *grid, struct connection *con, struct point from, struct point to) {
+    tile_nets.resize(grid->nzblocks);
 
-        if (next->p.x - prev_pos.x != prev_vec.x ||
-            next->p.y - prev_pos.y != prev_vec.y || next == first || cnt > 5) {
-          cnt = 0;
-            line new_line = {
-                .start = {scalex(current->p.x), scalex(current->p.y)},
-                .end = {scalex(last_x), scalex(last_y)},
-                .obstacle_points = obstacle_points,
-            };
+    for (struct point end : {from, to}) {
+        for (auto *other : tile_nets[grid_tile(grid, end.x, end.y)]) {
+            auto &feeds = trace_feeds[other];
 
-            lines.push_back(new_line);
+            if (other == con || std::find(feeds.begin(), feeds.end(), con) != feeds.end()) {
+                continue;
+            }
 
-            prev_vec = {next->p.x - prev_pos.x, next->p.y - prev_pos.y};
+            bool on = false;
+
+            for (auto &line : find_trace(other)->lines) {
+                for (auto &p : line.obstacle_points) {
+                    on = on || (p.x == end.x && p.y == end.y);
+                }
+            }
 
-            last_x = current->p.x;
-            last_y = current->p.y;
+            if (on) {
+                feeds.push_back(con);
+            }
         }
+    }
+}
 
-        prev_pos = {current->p.x, current->p.y};
-        current = next;
+void forget_trace(struct lead *lead, struct connection *con) {
+    auto &list = lead->traces;
 
-        if (next == first) {
-          struct trace new_trace = {
-            .lines = lines,
-            .con = con,
-          };
+    list.erase(std::remove_if(list.begin(), list.end(),
+                              [con](struct trace &trace) { return trace.con == con; }),
+               list.end());
+    lead->revision++;
+}
+
+/* Remove the trace of con from the board along with every trace that ends on
+ * its copper, adding them all to ripped. Traces of the same net may share
+ * copper with it, so the other traces of the tiles it left are laid again. */
+void rip_up(struct zgrid *grid, struct connection *con, std::vector<connection *> &ripped) {
+    struct trace *trace = find_trace(con);
+
+    if (!trace) {
+        return;
+    }
 
-          traces.push_back(new_trace);
+    std::vector<size_t> tiles {};
 
-          con->start->traces.push_back(new_trace);
-          con->end->traces.push_back(new_trace);
-          break;
+    for (auto &line : trace->lines) {
+        for (auto &p : line.obstacle_points) {
+            size_t z = grid_tile(grid, p.x, p.y);
+
+            grid_set_obstacle(grid, p.x, p.y, NIL, 0);
+
+            if (std::find(tiles.begin(), tiles.end(), z) == tiles.end()) {
+                tiles.push_back(z);
+            }
+        }
+    }
+
+    traces.erase(traces.begin() + (trace - traces.data()));
+    forget_trace(con->start, con);
+    forget_trace(con->end, con);
+
+    for (size_t z : tiles) {
+        auto &nets = tile_nets[z];
+        nets.erase(std::remove(nets.begin(), nets.end(), con), nets.end());
+
+        for (auto *other : nets) {
+            int gap = net_rules[other->rule].clearance;
+
+            for (auto &line : find_trace(other)->lines) {
+                for (auto &p : line.obstacle_points) {
+                    if (grid_tile(grid, p.x, p.y) == z) {
+                        grid_set_obstacle(grid, p.x, p.y, LINE, gap);
+                    }
+                }
+            }
+        }
+    }
+
+    ripped.push_back(con);
+
+    std::vector<connection *> feeds = std::move(trace_feeds[con]);
+    trace_feeds.erase(con);
+
+    for (auto &entry : trace_feeds) {
+        auto &list = entry.second;
+        list.erase(std::remove(list.begin(), list.end(), con), list.end());
+    }
+
+    for (auto *other : feeds) {
+        rip_up(grid, other, ripped);
+    }
+}
+
+/* Rip up every trace that comes within its net class clearance of area */
+void rip_up_area(struct zgrid *grid, struct zrect area, std::vector<connection *> &ripped) {
+    int max_clearance = 0;
+
+    for (auto &rule : net_rules) {
+        max_clearance = std::max(max_clearance, rule.clearance);
+    }
+
+    struct zrect reach = rect_grow(grid, area, max_clearance);
+    struct zrect span = tile_span(reach);
+    std::vector<connection *> hits {};
+
+    tile_nets.resize(grid->nzblocks);
+
+    for (int by = span.y0; by <= span.y1; by++) {
+        for (int bx = span.x0; bx <= span.x1; bx++) {
+            for (auto *con : tile_nets[bx + by * grid->nwidth]) {
+                if (std::find(hits.begin(), hits.end(), con) != hits.end()) {
+                    continue;
+                }
+
+                struct zrect keep = rect_grow(grid, area, net_rules[con->rule].clearance);
+                bool hit = false;
+
+                for (auto &line : find_trace(con)->lines) {
+                    for (auto &p : line.obstacle_points) {
+                        hit = hit || rect_contains(keep, p.x, p.y);
+                    }
+                }
+
+                if (hit) {
+                    hits.push_back(con);
+                }
+            }
         }
     }
+
+    for (auto *con : hits) {
+        rip_up(grid, con, ripped);
+    }
+}
+
+/* Copies of trace data kept by the board, allocated in board_arena() whatever
+ * the resource of the original */
+static struct line board_line(const struct line &line) {
+    return (struct line) {
+        .start = line.start,
+        .end = line.end,
+        .obstacle_points = std::pmr::vector<point>(line.obstacle_points, board_arena()),
+    };
+}
+
+static struct trace board_trace(const struct trace &trace) {
+    struct trace copy = {
+        .lines = std::pmr::vector<line>(board_arena()),
+        .con = trace.con,
+        .bound = trace.bound,
+    };
+
+    copy.lines.reserve(trace.lines.size());
+
+    for (auto &line : trace.lines) {
+        copy.lines.push_back(board_line(line));
+    }
+
+    return copy;
+}
+
+/* Commit a path running from the destination to the first node: simplify it,
+ * lay the trace footprint of every segment on the grid and record the trace. */
+void commit_path(connection *con, std::pmr::vector<point> &path, zgrid *grid, zgrid *work_grid,
+                 float bound) {
+    int half = net_rules[con->rule].width / 2;
+    int gap = net_rules[con->rule].clearance;
+    std::pmr::vector<point> corners {route_arena()};
+    std::pmr::vector<line> lines {board_arena()};
+
+    simplify_path(path, work_grid, &net_rules[con->rule], corners);
+
+    for (size_t i = 0; i + 1 < corners.size(); i++) {
+        struct point a = corners[i];
+        struct point b = corners[i + 1];
+
+        /* Footprint grows in the route arena, the copy kept in lines is
+         * allocated once at its final size */
+        line new_line = {
+            .start = {scalex(a.x), scalex(a.y)},
+            .end = {scalex(b.x), scalex(b.y)},
+            .obstacle_points = std::pmr::vector<point>(route_arena()),
+        };
+
+        walk_segment(a, b, [&](int cx, int cy) {
+            for (int y = std::max(cy - half, 0);
+                 y <= std::min(cy + half, (int)grid->height - 1); y++) {
+                for (int x = std::max(cx - half, 0);
+                     x <= std::min(cx + half, (int)grid->width - 1); x++) {
+                    /* Copper of other nets, or laid by this trace already */
+                    if (get_node(work_grid, x, y)->p.obstacle)
+                        continue;
+
+                    grid_set_obstacle(grid, x, y, LINE, gap);
+                    grid_set_obstacle(work_grid, x, y, LINE, gap);
+                    new_line.obstacle_points.push_back(get_node(grid, x, y)->p);
+                    /* DrawRectangle(scalex(x), scaley(y), 1, 1, GREEN); */
+                }
+            }
+
+            return 0;
+        });
+
+        lines.push_back(board_line(new_line));
+    }
+
+    struct trace new_trace = {
+      .lines = std::move(lines),
+      .con = con,
+      .bound = bound,
+    };
+
+    if (!corners.empty()) {
+        track_feeds(grid, con, corners.front(), corners.back());
+    }
+
+    traces.push_back(board_trace(new_trace));
+    track_trace(grid, &traces.back());
+
+    con->start->traces.push_back(board_trace(new_trace));
+    con->end->traces.push_back(std::move(new_trace));
+    con->start->revision++;
+    con->end->revision++;
+}
+
+void draw_path(connection *con, node *first, node *dest, zgrid *grid, zgrid *work_grid,
+               float bound) {
+    std::pmr::vector<point> path {route_arena()};
+
+    if (first == dest || backtrace(first, dest, work_grid, path)) {
+        return;
+    }
+
+    commit_path(con, path, grid, work_grid, bound);
 }
 
 #define HEURISTIC_D1 0.15
@@ -197,7 +585,7 @@ void disable_obstacles(struct lead *lead, struct zgrid *work_grid)  {
   for (auto &trace : lead->traces) {
     for (auto &line : trace.lines) {
       for (auto &obstacle_point : line.obstacle_points) {
-        get_node(work_grid, obstacle_point.x, obstacle_point.y)->p.obstacle = NIL;
+        grid_set_obstacle(work_grid, obstacle_point.x, obstacle_point.y, NIL, 0);
       }
     }
   }
@@ -211,7 +599,84 @@ int build_work_grid(struct connection *con, struct zgrid *work_grid) {
   return 0;
 }
 
-int search(struct node *first, struct node *dest, struct zgrid *grid, bool indefinite ) {
+#define CORRIDOR_MARGIN 8
+
+size_t rect_area(struct zrect rect) {
+    return (size_t)(rect.x1 - rect.x0 + 1) * (rect.y1 - rect.y0 + 1);
+}
+
+/* Grow the search window geometrically, resetting only the cells outside
+ * the previous window. Returns the previous window. */
+struct zrect grow_window(struct zgrid *grid, struct zrect *window) {
+    struct zrect old = *window;
+    int extent = std::max(old.x1 - old.x0, old.y1 - old.y0);
+
+    *window = rect_grow(grid, old, extent / 2 + 1);
+    grid_reset_area(grid, rect_grow(grid, *window, 1), &old);
+
+    return old;
+}
+
+/* Grow the search window and continue from the border of the previous one:
+ * settled nodes keep their distances, the newly exposed ring is seeded from
+ * the visited nodes on the old border. */
+struct node *widen_corridor(struct zgrid *grid, struct zrect *window, struct node *first,
+                            struct node *dest, struct net_rule *rule, size_t *unvisited_num) {
+    struct zrect old = grow_window(grid, window);
+    *unvisited_num += rect_area(*window) - rect_area(old);
+
+    struct node *next = NULL;
+    float next_dist = INFINITY;
+
+    for (int y = old.y0; y <= old.y1; y++) {
+        for (int x = old.x0; x <= old.x1; x++) {
+            if (x != old.x0 && x != old.x1 && y != old.y0 && y != old.y1) {
+                x = old.x1 - 1;
+                continue;
+            }
+
+            struct node *border = get_node(grid, x, y);
+
+            if (!border->visited || border->p.obstacle) {
+                continue;
+            }
+
+            for (int ny = y - 1; ny <= y + 1; ny++) {
+                for (int nx = x - 1; nx <= x + 1; nx++) {
+                    if (rect_contains(old, nx, ny) ||
+                        !rect_contains(*window, nx, ny)) {
+                        continue;
+                    }
+
+                    struct node *node = get_node(grid, nx, ny);
+
+                    if (!passable(node, first, dest, rule)) {
+                        continue;
+                    }
+
+                    float dist = euclid_distance(&node->p, &border->p) +
+                                 border->distance;
+
+                    if (node->distance > dist) {
+                        node->distance = dist;
+                    }
+
+                    float f_dist = node->distance + heuristic(node, dest);
+
+                    if (f_dist < next_dist) {
+                        next_dist = f_dist;
+                        next = node;
+                    }
+                }
+            }
+        }
+    }
+
+    return next;
+}
+
+int search(struct node *first, struct node *dest, struct zgrid *grid,
+           struct zrect *window, struct net_rule *rule, bool indefinite) {
     std::queue<struct node *> unvisited{};
     unvisited.push(first);
 
@@ -219,28 +684,27 @@ int search(struct node *first, struct node *dest, struct zgrid *grid, bool indef
         return 0;
     }
 
-    size_t unvisited_num = grid->width * grid->height;
+    size_t unvisited_num = rect_area(*window);
 
     struct node *current = first;
+    bool reopened = false;
     first->distance = 0.f;
 
     while (unvisited_num > 0) {
         struct node *next = NULL;
         float next_dist = INFINITY;
 
-        for (int y = ((current->p.y >= grid->height - 1) ? 0 : 1);
-             y >= (current->p.y ? -1 : 0); y--) {
+        for (int y = ((current->p.y >= window->y1) ? 0 : 1);
+             y >= ((current->p.y > window->y0) ? -1 : 0); y--) {
 
-            for (int x = (current->p.x ? -1 : 0);
-                 x <= ((current->p.x >= grid->width - 1) ? 0 : 1); x++) {
+            for (int x = ((current->p.x > window->x0) ? -1 : 0);
+                 x <= ((current->p.x >= window->x1) ? 0 : 1); x++) {
 
                 struct node *node =
                     get_node(grid, current->p.x + x, current->p.y + y);
 
-                if (node->p.obstacle) {
-                }
-
-                if (node->visited || node == current || node->p.obstacle) {
+                if (node->visited || node == current ||
+                    !passable(node, first, dest, rule)) {
                     continue;
                 }
 
@@ -280,9 +744,19 @@ int search(struct node *first, struct node *dest, struct zgrid *grid, bool indef
                 }
             }
 
+            /* current is settled already: keep widening until the window
+             * exposes a node, or covers the board and the fallback below runs */
+            while (!next && !rect_equal(*window, grid_rect(grid))) {
+                next = widen_corridor(grid, window, first, dest, rule, &unvisited_num);
+            }
+
             if (!next) {
 
-              if (indefinite) {
+              /* Once: a second exhausted board means dest is unreachable */
+              if (indefinite && !reopened) {
+                reopened = true;
+                grid_own_area(grid, grid_rect(grid));
+
                 grid_foreach(node, grid) {
                     node->visited = false;
                     node->distance = INFINITY;
@@ -309,13 +783,281 @@ int search(struct node *first, struct node *dest, struct zgrid *grid, bool indef
         }
     }
 
-    if (unvisited_num == 0) {
-        fprintf(stderr, "Dijkstra error: unvisited: %zu, point: %d:%d\n",
-                unvisited_num, current->p.x, current->p.y);
-        return 1;
+    if (unvisited_num == 0) {
+        fprintf(stderr, "Dijkstra error: unvisited: %zu, point: %d:%d\n",
+                unvisited_num, current->p.x, current->p.y);
+        return 1;
+    }
+
+    return 0;
+}
+
+int octile_heuristic(struct node *node, struct node *dest) {
+    int dx = abs(node->p.x - dest->p.x);
+    int dy = abs(node->p.y - dest->p.y);
+
+    return COST_STRAIGHT * std::max(dx, dy) +
+           (COST_DIAGONAL - COST_STRAIGHT) * std::min(dx, dy);
+}
+
+/* Call fn for every cell on the border of rect */
+template <typename F>
+void foreach_border(struct zrect rect, F fn) {
+    for (int y = rect.y0; y <= rect.y1; y++) {
+        for (int x = rect.x0; x <= rect.x1; x++) {
+            if (x != rect.x0 && x != rect.x1 && y != rect.y0 && y != rect.y1) {
+                x = rect.x1 - 1;
+                continue;
+            }
+
+            fn(x, y);
+        }
+    }
+}
+
+/* A* over window with integer octile costs and a bucket queue. The cost so
+ * far goes to node->distance, exact in a float, and closed nodes are the
+ * visited ones, so backtrace() walks the result as before. The window is
+ * fenced with closed nodes and the board with the halo, so every expansion
+ * runs relax_kernel() on all 8 neighbours without bounds checks. When the
+ * window runs dry it is widened and the closed nodes on its old border are
+ * expanded again into the new ring. Returns -1 if dest can't be reached. */
+int octile_search(struct node *first, struct node *dest, struct zgrid *grid,
+                  struct zrect *window, struct net_rule *rule) {
+    static struct bucket_queue open {};
+    struct relax_params params = {
+        .first_x = first->p.x,
+        .first_y = first->p.y,
+        .dest_x = dest->p.x,
+        .dest_y = dest->p.y,
+        .reach = rule_reach(rule),
+    };
+    struct relax_lanes lanes;
+
+    auto expand = [&](struct node *current) {
+        struct node *around[8];
+        grid_neighbours(grid, current, around);
+
+        for (int k = 0; k < 8; k++) {
+            lanes.distance[k] = around[k]->distance;
+            lanes.visited[k] = around[k]->visited;
+            lanes.clearance[k] = rule_clearance(around[k], rule);
+            lanes.obstacle[k] = around[k]->p.obstacle;
+        }
+
+        params.x = current->p.x;
+        params.y = current->p.y;
+        params.cost = (int)current->distance;
+
+        for (unsigned int mask = relax_kernel(&params, &lanes); mask; mask &= mask - 1) {
+            int k = __builtin_ctz(mask);
+
+            around[k]->distance = lanes.cost[k];
+            bucket_push(&open, lanes.key[k], around[k]);
+        }
+    };
+
+    bucket_clear(&open);
+    grid_fence(grid, *window);
+    first->distance = 0.f;
+    bucket_push(&open, octile_heuristic(first, dest), first);
+
+    for (;;) {
+        struct node *current;
+
+        while ((current = bucket_pop(&open))) {
+            if (current->visited) {
+                continue;
+            }
+
+            current->visited = true;
+
+            if (current == dest) {
+                return 0;
+            }
+
+            expand(current);
+        }
+
+        if (rect_equal(*window, grid_rect(grid))) {
+            return -1;
+        }
+
+        struct zrect old = grow_window(grid, window);
+        grid_fence(grid, *window);
+
+        foreach_border(old, [&](int x, int y) {
+            struct node *border = get_node(grid, x, y);
+
+            if (border->visited > 0 && !border->p.obstacle) {
+                expand(border);
+            }
+        });
+    }
+}
+
+/* Heuristic weights are fixed point, in 1/WEIGHT_ONE */
+#define WEIGHT_ONE 16
+
+/* Anytime A* (ARA*) over window, integer costs as in octile_search(). The
+ * first pass inflates the heuristic by route_opts.anytime_weight and widens
+ * the window until it reaches dest. Unless improve is false, every further
+ * pass lowers the weight by a half and carries on from the previous one:
+ * costs are kept, the open nodes and the closed ones whose cost dropped
+ * (INCONS) are keyed again, and closing stamps node->visited with the pass
+ * number so a new pass starts with nothing closed. Passes stop at weight 1
+ * or once the budget set in route_opts runs out, which is only checked once
+ * a path exists. The bound holds against the optimum within the window. */
+struct search_result anytime_search(struct node *first, struct node *dest, struct zgrid *grid,
+                                    struct zrect *window, struct net_rule *rule, bool improve) {
+    static struct bucket_queue open {};
+    static std::vector<struct node *> incons {};
+    static std::vector<struct node *> pending {};
+    int weight = std::max((int)lroundf(route_opts.anytime_weight * WEIGHT_ONE), WEIGHT_ONE);
+    int pass = 1;
+    size_t expansions = 0;
+    double deadline = session_clock() + route_opts.anytime_ms;
+    bool spent = false;
+    struct search_result result = {
+        .status = 0,
+        .bound = (float)weight / WEIGHT_ONE,
+        .iterations = 0,
+    };
+    struct relax_params params = {
+        .first_x = first->p.x,
+        .first_y = first->p.y,
+        .dest_x = dest->p.x,
+        .dest_y = dest->p.y,
+        .reach = rule_reach(rule),
+    };
+    struct relax_lanes lanes;
+
+    if (first == dest) {
+        result.bound = 1.f;
+        return result;
+    }
+
+    auto key = [&](int cost, int heuristic) {
+        return (size_t)cost + (size_t)heuristic * weight / WEIGHT_ONE;
+    };
+
+    auto dest_key = [&]() {
+        return dest->distance == INFINITY ? SIZE_MAX : (size_t)dest->distance;
+    };
+
+    /* Closed nodes are relaxed too, those improved go to INCONS */
+    auto expand = [&](struct node *current) {
+        struct node *around[8];
+        grid_neighbours(grid, current, around);
+
+        for (int k = 0; k < 8; k++) {
+            lanes.distance[k] = around[k]->distance;
+            lanes.visited[k] = around[k]->visited == NODE_FENCE;
+            lanes.clearance[k] = rule_clearance(around[k], rule);
+            lanes.obstacle[k] = around[k]->p.obstacle;
+        }
+
+        params.x = current->p.x;
+        params.y = current->p.y;
+        params.cost = (int)current->distance;
+
+        for (unsigned int mask = relax_kernel(&params, &lanes); mask; mask &= mask - 1) {
+            int k = __builtin_ctz(mask);
+
+            around[k]->distance = lanes.cost[k];
+
+            if (around[k]->visited == pass) {
+                incons.push_back(around[k]);
+            } else {
+                bucket_push(&open, key(lanes.cost[k], lanes.key[k] - lanes.cost[k]), around[k]);
+            }
+        }
+
+        if (!(++expansions & 63) && session_clock() > deadline && route_opts.anytime_ms > 0) {
+            spent = true;
+        }
+
+        if (route_opts.anytime_expansions && expansions >= (size_t)route_opts.anytime_expansions) {
+            spent = true;
+        }
+    };
+
+    bucket_clear(&open);
+    incons.clear();
+    grid_fence(grid, *window);
+    first->distance = 0.f;
+    bucket_push(&open, key(0, octile_heuristic(first, dest)), first);
+
+    for (;;) {
+        while (bucket_top(&open) < dest_key() && !(spent && result.iterations)) {
+            struct node *current = bucket_pop(&open);
+
+            if (current->visited == pass) {
+                continue;
+            }
+
+            current->visited = pass;
+            expand(current);
+        }
+
+        if (spent && result.iterations) {
+            break;
+        }
+
+        if (dest->distance == INFINITY) {
+            if (rect_equal(*window, grid_rect(grid))) {
+                result.status = -1;
+                break;
+            }
+
+            struct zrect old = grow_window(grid, window);
+            grid_fence(grid, *window);
+
+            foreach_border(old, [&](int x, int y) {
+                struct node *border = get_node(grid, x, y);
+
+                if (border->visited > 0 && !border->p.obstacle) {
+                    expand(border);
+                }
+            });
+
+            continue;
+        }
+
+        /* The pass is complete: OPEN and INCONS, without the stale entries
+         * of nodes closed since, give the bound and the next open set */
+        result.iterations++;
+        pending.clear();
+        bucket_drain(&open, pending);
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [&](struct node *node) { return node->visited == pass; }),
+                      pending.end());
+        pending.insert(pending.end(), incons.begin(), incons.end());
+        incons.clear();
+        std::sort(pending.begin(), pending.end());
+        pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+        float lower = INFINITY;
+
+        for (struct node *node : pending) {
+            lower = std::min(lower, node->distance + octile_heuristic(node, dest));
+        }
+
+        result.bound = std::max(1.f, std::min((float)weight / WEIGHT_ONE, dest->distance / lower));
+
+        if (!improve || spent || weight == WEIGHT_ONE || result.bound <= 1.f) {
+            break;
+        }
+
+        weight = std::max(weight - WEIGHT_ONE / 2, WEIGHT_ONE);
+        pass++;
+
+        for (struct node *node : pending) {
+            bucket_push(&open, key((int)node->distance, octile_heuristic(node, dest)), node);
+        }
     }
 
-    return 0;
+    return result;
 }
 
 float total_path_dist(struct node *first, struct node *dest, struct zgrid *grid) {
@@ -325,37 +1067,31 @@ float total_path_dist(struct node *first, struct node *dest, struct zgrid *grid)
     while (current != first) {
         struct node *next = NULL;
         float next_dist = INFINITY;
-        std::vector<point> obstacle_points{};
 
-        for (int y = (current->p.y ? -1 : 0);
-             y <= ((current->p.y >= grid->height - 1) ? 0 : 1); y++) {
-            for (int x = (current->p.x ? -1 : 0);
-                 x <= ((current->p.x >= grid->width - 1) ? 0 : 1); x++) {
-                struct node *node =
-                    get_node(grid, current->p.x + x, current->p.y + y);
+        struct node *around[8];
+        grid_neighbours(grid, current, around);
 
-                if (node->p.obstacle)
-                    continue;
+        for (struct node *node : around) {
+            if (node->p.obstacle)
+                continue;
 
-                if (!node->visited || node == current) {
-                    continue;
-                }
+            if (!node->visited) {
+                continue;
+            }
 
-                float dist = node->distance;
+            float dist = node->distance;
 
-                if (dist < next_dist) {
-                    next_dist = dist;
-                    next = node;
-                }
+            if (dist < next_dist) {
+                next_dist = dist;
+                next = node;
             }
         }
 
-        dist += next_dist;
-
-        if (!next) {
-            break;
+        if (!next || next_dist >= current->distance) {
+            return INFINITY;
         }
 
+        dist += next_dist;
         current = next;
 
         if (next == first) {
@@ -367,18 +1103,37 @@ float total_path_dist(struct node *first, struct node *dest, struct zgrid *grid)
 }
 
 void restore_work_grid(struct zgrid *grid, struct zgrid *work_grid) {
-  for (size_t i = 0; i < grid->nzblocks; i++) {
-    std::copy(std::begin(grid->blocks[i].nodes), std::end(grid->blocks[i].nodes), std::begin(work_grid->blocks[i].nodes));
-  }
+  /* Bring the clearances of the traces just committed up to date first */
+  grid_update_clearance(grid);
+  grid_share(work_grid, grid);
 }
 
-void dijkstra_search(struct zgrid *grid, struct node *first, struct node *dest, bool indefinite) {
-  grid_foreach(node, grid) {
-    node->visited = false;
-    node->distance = INFINITY;
+struct search_result dijkstra_search(struct zgrid *grid, struct node *first, struct node *dest,
+                                     struct net_rule *rule, bool indefinite) {
+  struct zrect window = rect_around(grid, &first->p, &dest->p, CORRIDOR_MARGIN);
+
+  /* One extra ring so draw_path() never sees stale state next to the path */
+  grid_reset_area(grid, rect_grow(grid, window, 1), NULL);
+
+  /* Both widen up to the whole grid by themselves, indefinite or not */
+  if (route_opts.integer_costs && route_opts.anytime) {
+    /* Candidate endpoints are compared on the first, inflated pass */
+    return anytime_search(first, dest, grid, &window, rule, indefinite);
   }
-  
-  search(first, dest, grid, indefinite);
+
+  if (route_opts.integer_costs) {
+    return (struct search_result) {
+      .status = octile_search(first, dest, grid, &window, rule),
+      .bound = 1.f,
+      .iterations = 1,
+    };
+  }
+
+  return (struct search_result) {
+    .status = search(first, dest, grid, &window, rule, indefinite),
+    .bound = 0.f,
+    .iterations = 1,
+  };
 }
 
 int check_matched(struct lead *prev, struct lead *l, struct lead *goal) {
@@ -397,36 +1152,168 @@ int check_matched(struct lead *prev, struct lead *l, struct lead *goal) {
   return 0;
 }
 
-int dijkstra(std::vector<connection> &connects, struct zgrid *grid) {
+/* Route con through the distance field of its busier lead when that lead is
+ * a hub of this pass and the other end has no traces of its own yet: the
+ * route is then a backtrace instead of a search. */
+int field_route(struct connection *con, struct zgrid *grid, struct zgrid *work_grid,
+                std::unordered_map<struct lead *, int> &uses) {
+  struct lead *hub = (uses[con->start] >= uses[con->end]) ? con->start : con->end;
+  struct lead *other = (hub == con->start) ? con->end : con->start;
+
+  if (uses[hub] < route_opts.hub_connections || other->traces.size() > 1) {
+    return 1;
+  }
+
+  struct lead_field *field = field_get(grid, hub, &net_rules[con->rule]);
+  std::pmr::vector<point> path {route_arena()};
+
+  struct point from = {
+    .x = other->orig.x / 4,
+    .y = other->orig.y / 4,
+    .obstacle = NIL,
+  };
+
+  if (field_path(field, grid, from, path) || path.size() < 2) {
+    return 1;
+  }
+
+  /* Fields are exact Dijkstra */
+  commit_path(con, path, grid, work_grid, 1.f);
+
+  return 0;
+}
+
+/* Whether cell (x, y) is copper of the net of lead: its pad or a trace */
+static bool on_net(struct lead *lead, struct point cell) {
+    for (auto &trace : lead->traces) {
+        for (auto &line : trace.lines) {
+            if ((line.start.x / 4 == cell.x && line.start.y / 4 == cell.y) ||
+                (line.end.x / 4 == cell.x && line.end.y / 4 == cell.y)) {
+                return true;
+            }
+
+            for (auto &p : line.obstacle_points) {
+                if (p.x == cell.x && p.y == cell.y) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/* Route con along the path cached for key if nothing changed under it and
+ * it still ends on both nets: a trace it joined may have been ripped up */
+int cached_route(struct connection *con, struct route_key *key, struct zgrid *grid,
+                 struct zgrid *work_grid) {
+  std::pmr::vector<point> path {route_arena()};
+  struct net_rule *rule = &net_rules[con->rule];
+  float bound;
+
+  auto fits = [&](int x, int y) {
+    struct node *first = get_node(work_grid, path.back().x, path.back().y);
+    struct node *dest = get_node(work_grid, path.front().x, path.front().y);
+
+    return passable(get_node(work_grid, x, y), first, dest, rule) != 0;
+  };
+
+  if (route_cache_get(grid, key, fits, path, &bound)) {
+    return 1;
+  }
+
+  if (!(on_net(con->start, path.front()) && on_net(con->end, path.back())) &&
+      !(on_net(con->end, path.front()) && on_net(con->start, path.back()))) {
+    return 1;
+  }
+
+  commit_path(con, path, grid, work_grid, bound);
+
+  return 0;
+}
+
+/* Cache the trace just committed for con under key */
+void remember_route(struct connection *con, struct route_key *key, struct zgrid *grid) {
+  struct trace *trace = find_trace(con);
+
+  if (!trace || trace->lines.empty()) {
+    return;
+  }
+
+  std::vector<point> path {};
+  std::vector<point> cells {};
+
+  for (auto &line : trace->lines) {
+    path.push_back({line.start.x / 4, line.start.y / 4});
+  }
+
+  path.push_back({trace->lines.back().end.x / 4, trace->lines.back().end.y / 4});
+
+  for (size_t i = 0; i + 1 < path.size(); i++) {
+    walk_segment(path[i], path[i + 1], [&](int x, int y) {
+      cells.push_back({x, y});
+      return 0;
+    });
+  }
+
+  route_cache_put(grid, key, path, cells, trace->bound);
+}
+
+int dijkstra(std::vector<connection *> &connects, struct zgrid *grid) {
     int ret = 0;
+    std::unordered_map<struct lead *, int> uses {};
+
+    for (auto *con : connects) {
+      uses[con->start]++;
+      uses[con->end]++;
+    }
 
+    grid_update_clearance(grid);
 
     struct zgrid work_grid {};
     if (grid_copy(grid, &work_grid)) {
         return 1;
     }
 
-    for (auto &con : connects) { // 
-      if (check_matched(NULL, con.start, con.end)) {
+    for (auto *con : connects) { // 
+      if (check_matched(NULL, con->start, con->end)) {
         continue;
       }
 
-      struct node *first = get_node(&work_grid, con.start->orig.x / 4, con.start->orig.y / 4);
-      struct node *real_dest = get_node(&work_grid, con.end->orig.x / 4, con.end->orig.y / 4);
+      /* Endpoints are taken writable: the searches below would clone their
+       * tiles anyway and the pointers must survive that */
+      struct node *first = get_node_w(&work_grid, con->start->orig.x / 4, con->start->orig.y / 4);
+      struct node *real_dest = get_node_w(&work_grid, con->end->orig.x / 4, con->end->orig.y / 4);
       struct node *closest_dest = real_dest;
       struct node *best_first = first;
       float tot_dist = INFINITY;
-      
-      build_work_grid(&con, &work_grid);
+      struct net_rule *rule = &net_rules[con->rule];
+      /* Taken before routing adds a trace to either lead */
+      struct route_key key {};
+
+      route_key_of(grid, con, &key);
+      build_work_grid(con, &work_grid);
+      grid_update_clearance(&work_grid);
+
+      if ((route_opts.route_cache && !cached_route(con, &key, grid, &work_grid)) ||
+          (route_opts.field_cache && !field_route(con, grid, &work_grid, uses))) {
+        if (route_opts.route_cache) {
+          remember_route(con, &key, grid);
+        }
 
-      for (auto &trace : con.start->traces) {
+        restore_work_grid(grid, &work_grid);
+        route_arena_reset();
+        continue;
+      }
+
+      for (auto &trace : con->start->traces) {
         for (auto &line : trace.lines) {
-          for (auto &trace_end : con.end->traces) {
+          for (auto &trace_end : con->end->traces) {
             for (auto &line_end : trace_end.lines) {
-              struct node *dest = get_node(&work_grid, line.start.x / 4, line.start.y / 4);
-              struct node *beg = get_node(&work_grid, line_end.start.x / 4, line_end.start.y / 4);
+              struct node *dest = get_node_w(&work_grid, line.start.x / 4, line.start.y / 4);
+              struct node *beg = get_node_w(&work_grid, line_end.start.x / 4, line_end.start.y / 4);
               
-              dijkstra_search(&work_grid, beg, dest, false);
+              dijkstra_search(&work_grid, beg, dest, rule, false);
               
               if (total_path_dist(beg, dest, &work_grid) < tot_dist) {
                 closest_dest = dest;
@@ -440,17 +1327,29 @@ int dijkstra(std::vector<connection> &connects, struct zgrid *grid) {
         }
       }
 
-      dijkstra_search(&work_grid, best_first, closest_dest, true);
+      struct search_result result = dijkstra_search(&work_grid, best_first, closest_dest, rule, true);
+
+      /* Replays route without a window */
+      bool window = IsWindowReady();
 
-      BeginTextureMode(target);
-      BeginMode2D(camera);
+      if (window) {
+        BeginTextureMode(target);
+        BeginMode2D(camera);
+      }
 
-      draw_path(&con, best_first, closest_dest, grid, &work_grid);
+      draw_path(con, best_first, closest_dest, grid, &work_grid, result.bound);
+
+      if (window) {
+        EndMode2D();
+        EndTextureMode();
+      }
 
-      EndMode2D();
-      EndTextureMode();
+      if (route_opts.route_cache) {
+        remember_route(con, &key, grid);
+      }
 
       restore_work_grid(grid, &work_grid);
+      route_arena_reset();
     }
 
     delete_zgrid(&work_grid);
@@ -460,7 +1359,16 @@ int dijkstra(std::vector<connection> &connects, struct zgrid *grid) {
 
 int route(std::vector<connection> &circuit, struct zgrid *grid) {
     int ret = 0;
-    ret = dijkstra(circuit, grid);
+    std::vector<connection *> pending {};
+
+    session_log(SESSION_ROUTE, 0, 0, 0);
+
+    for (auto &con : circuit) {
+        nets.push_back(con);
+        pending.push_back(&nets.back());
+    }
+
+    ret = dijkstra(pending, grid);
     /* ret |= draw(circuit, grid); */
 
     return ret;
@@ -475,52 +1383,496 @@ void grid_fill(struct grid *grid) {
     }
 }
 
-int add_lead(struct zgrid *circ, struct point pos) {
-    for (int y = ((pos.y >= circ->height - 1) ? 0 : 1); y >= (pos.y ? -1 : 0);
-         y--) {
+struct zrect pad_rect(struct zgrid *grid, struct point pos) {
+    int half = route_opts.pad_width / 2;
 
-        for (int x = (pos.x ? -1 : 0);
-             x <= ((pos.x >= circ->width - 1) ? 0 : 1); x++) {
+    return (struct zrect) {
+        .x0 = std::max(pos.x - half, 0),
+        .y0 = std::max(pos.y - half, 0),
+        .x1 = std::min(pos.x + half, (int)grid->width - 1),
+        .y1 = std::min(pos.y + half, (int)grid->height - 1),
+    };
+}
 
-            struct node *node = get_node(circ, pos.x + x, pos.y + y);
+/* Pads keep the default net class clearance to other pads, traces in the
+ * way get ripped up and rerouted instead. own is the pad being moved. */
+int pad_blocked(struct zgrid *grid, struct zrect pad, struct zrect *own) {
+    struct zrect area = rect_grow(grid, pad, net_rules[0].clearance);
 
-            if (node->p.obstacle) {
+    for (int y = area.y0; y <= area.y1; y++) {
+        for (int x = area.x0; x <= area.x1; x++) {
+            if (get_node(grid, x, y)->p.obstacle == LEAD &&
+                !(own && rect_contains(*own, x, y))) {
                 return 1;
             }
         }
     }
 
-    for (int y = ((pos.y >= circ->height - 1) ? 0 : 1); y >= (pos.y ? -1 : 0);
-         y--) {
+    return 0;
+}
+
+void set_pad(struct zgrid *grid, struct zrect pad, OBSTACLE obstacle) {
+    for (int y = pad.y0; y <= pad.y1; y++) {
+        for (int x = pad.x0; x <= pad.x1; x++) {
+            grid_set_obstacle(grid, x, y, obstacle, 0);
+        }
+    }
+}
+
+/* Routes start at orig / 4 of a lead, which has to be a board cell: the
+ * halo around the board only covers the neighbours of board cells */
+int lead_fits(struct zgrid *grid, struct point pos) {
+    int x = (scalex(pos.x) - 5) / 4;
+    int y = (scaley(pos.y) - 5) / 4;
 
-        for (int x = (pos.x ? -1 : 0);
-             x <= ((pos.x >= circ->width - 1) ? 0 : 1); x++) {
+    return x >= 0 && y >= 0 && x < (int)grid->width && y < (int)grid->height;
+}
 
-            struct node *node = get_node(circ, pos.x + x, pos.y + y);
+int add_lead(struct zgrid *circ, struct point pos) {
+    struct zrect pad = pad_rect(circ, pos);
+    std::vector<connection *> ripped {};
 
-            node->p.obstacle = LEAD;
-        }
+    if (!lead_fits(circ, pos) || pad_blocked(circ, pad, NULL)) {
+        return 1;
     }
 
+    rip_up_area(circ, pad, ripped);
+    set_pad(circ, pad, LEAD);
+
     struct lead new_lead = {
         .orig = {scalex(pos.x) - 5, scaley(pos.y) - 5},
         .width = 10,
         .height = 10,
-        .traces = {},
+        .traces = std::pmr::vector<trace>(board_arena()),
     };
 
     struct trace self = {
-      .lines = {{ .start = new_lead.orig, .end = new_lead.orig }},
+      .lines = std::pmr::vector<line>(board_arena()),
       .con = NULL,
     };
 
-    new_lead.traces.push_back(self);
-    leads.push_back(new_lead);
+    self.lines.push_back({
+      .start = new_lead.orig,
+      .end = new_lead.orig,
+      .obstacle_points = std::pmr::vector<point>(board_arena()),
+    });
+    new_lead.traces.push_back(std::move(self));
+    leads.push_back(std::move(new_lead));
+    session_log(SESSION_LEAD, pos.x, pos.y, 0);
+
+    if (!ripped.empty()) {
+        dijkstra(ripped, circ);
+    }
+
+    return 0;
+}
+
+int lead_index(struct lead *lead) {
+    for (size_t i = 0; i < leads.size(); i++) {
+        if (&leads[i] == lead) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Move a lead, rerouting its own traces and those in the way of its new pad.
+ * Everything else stays committed. */
+int move_lead(struct zgrid *grid, struct lead *lead, struct point pos) {
+    struct point old_pos = {
+        .x = (lead->orig.x + 5) / 4,
+        .y = (lead->orig.y + 5) / 4,
+        .obstacle = NIL,
+    };
+    struct zrect old_pad = pad_rect(grid, old_pos);
+    struct zrect pad = pad_rect(grid, pos);
+    std::vector<connection *> own {};
+    std::vector<connection *> ripped {};
+
+    if (!lead_fits(grid, pos) || pad_blocked(grid, pad, &old_pad)) {
+        return 1;
+    }
+
+    for (auto &trace : lead->traces) {
+        if (trace.con) {
+            own.push_back(trace.con);
+        }
+    }
+
+    for (auto *con : own) {
+        rip_up(grid, con, ripped);
+    }
+
+    set_pad(grid, old_pad, NIL);
+    rip_up_area(grid, pad, ripped);
+    set_pad(grid, pad, LEAD);
+
+    lead->orig = {scalex(pos.x) - 5, scaley(pos.y) - 5};
+    lead->revision++;
+
+    for (auto &trace : lead->traces) {
+        if (!trace.con) {
+            trace.lines[0].start = lead->orig;
+            trace.lines[0].end = lead->orig;
+        }
+    }
+
+    session_log(SESSION_MOVE, lead_index(lead), pos.x, pos.y);
+    dijkstra(ripped, grid);
+
+    return 0;
+}
+
+void connect_leads(struct lead *start, struct lead *end, int rule) {
+    connections.push_back({
+        .start = start,
+        .end = end,
+        .rule = rule,
+    });
+    session_log(SESSION_CONNECT, lead_index(start), lead_index(end), rule);
+}
+
+/* Re-run a recorded session without a window, timing every route */
+/* Record the options routes depend on, so a replay routes the same way */
+void log_route_opts(void) {
+    session_log(SESSION_OPTS, route_opts.anytime, (int)lroundf(route_opts.anytime_ms * 1000.f),
+                route_opts.anytime_expansions);
+}
+
+void set_anytime(bool anytime) {
+    if (route_opts.anytime != anytime) {
+        /* Cached routes were found in the other mode */
+        route_cache_clear();
+    }
+
+    route_opts.anytime = anytime;
+    log_route_opts();
+}
+
+int replay(const char *path) {
+    std::vector<session_event> events {};
+
+    if (session_load(path, events)) {
+        fprintf(stderr, "Replay: can't load %s\n", path);
+        return 1;
+    }
+
+    struct zgrid zgrid = {0};
+    zgrid.height = GRID_HEIGHT;
+    zgrid.width = GRID_WIDTH;
+
+    create_zgrid(&zgrid);
+
+    double total = 0.;
+    int routes = 0;
+
+    for (auto &event : events) {
+        switch (event.op) {
+        case SESSION_LEAD: {
+            /* A pad dropped on traces reroutes them */
+            double start = session_clock();
+
+            if (add_lead(&zgrid, (point){.x = event.args[0], .y = event.args[1], .obstacle = NIL})) {
+                printf("Add lead failed\n");
+            }
+
+            double elapsed = session_clock() - start;
+            total += elapsed;
+
+            printf("lead at %d:%d at %.0f ms: %.3f ms\n", event.args[0], event.args[1], event.time,
+                   elapsed);
+            break;
+        }
+        case SESSION_CONNECT:
+            if (event.args[0] < 0 || event.args[0] >= (int)leads.size() ||
+                event.args[1] < 0 || event.args[1] >= (int)leads.size() ||
+                event.args[2] < 0 || event.args[2] >= (int)net_rules.size()) {
+                fprintf(stderr, "Replay: bad connection %d-%d\n", event.args[0], event.args[1]);
+                break;
+            }
+
+            connect_leads(&leads[event.args[0]], &leads[event.args[1]], event.args[2]);
+            break;
+        case SESSION_ROUTE: {
+            size_t pending = connections.size();
+            size_t committed = traces.size();
+            double start = session_clock();
+
+            route(connections, &zgrid);
+            connections.clear();
+
+            double elapsed = session_clock() - start;
+            total += elapsed;
+
+            printf("route %d at %.0f ms: %zu connections, %zu traces, %.3f ms\n", routes++,
+                   event.time, pending, traces.size() - committed, elapsed);
+            break;
+        }
+        case SESSION_MOVE: {
+            if (event.args[0] < 0 || event.args[0] >= (int)leads.size()) {
+                fprintf(stderr, "Replay: bad lead %d\n", event.args[0]);
+                break;
+            }
+
+            double start = session_clock();
+
+            if (move_lead(&zgrid, &leads[event.args[0]],
+                          (point){.x = event.args[1], .y = event.args[2], .obstacle = NIL})) {
+                printf("Move lead failed\n");
+            }
+
+            double elapsed = session_clock() - start;
+            total += elapsed;
+
+            printf("move of lead %d at %.0f ms: %.3f ms\n", event.args[0], event.time, elapsed);
+            break;
+        }
+        case SESSION_OPTS:
+            route_opts.anytime_ms = event.args[1] / 1000.f;
+            route_opts.anytime_expansions = event.args[2];
+            set_anytime(event.args[0]);
+
+            printf("anytime routing %s at %.0f ms, %.3f ms and %d expansions per connection\n",
+                   route_opts.anytime ? "on" : "off", event.time, route_opts.anytime_ms,
+                   route_opts.anytime_expansions);
+            break;
+        }
+    }
+
+    printf("%d routes, %.3f ms routing and rerouting\n", routes, total);
+    delete_zgrid(&zgrid);
 
     return 0;
 }
 
-int main() {
+static int valid_lead(int index) {
+    return index >= 0 && index < (int)leads.size();
+}
+
+static void append_lines(std::string &reply, struct trace *trace) {
+    reply += "[";
+
+    for (size_t i = 0; i < trace->lines.size(); i++) {
+        struct line &line = trace->lines[i];
+
+        json_append(reply, "%s[%d,%d,%d,%d]", i ? "," : "", line.start.x, line.start.y,
+                    line.end.x, line.end.y);
+    }
+
+    reply += "]";
+}
+
+/* Answer one daemon request against the resident board:
+ *   {"op":"add_lead","x":..,"y":..}
+ *   {"op":"connect","start":..,"end":..,"rule":..}
+ *   {"op":"route"}
+ *   {"op":"move","lead":..,"x":..,"y":..}
+ *   {"op":"query_trace","start":..,"end":..}
+ *   {"op":"snapshot"}
+ * Leads are addressed by index, a numeric "id" is echoed back. */
+static const char *const request_keys[] = {
+    "id", "op", "x", "y", "lead", "start", "end", "rule", NULL,
+};
+
+void handle_request(struct zgrid *grid, const char *json, std::string &reply) {
+    char op[32];
+    int id, x, y, start, end, rule = 0, index;
+    struct json_object request;
+    const char *error = json_parse(json, request_keys, &request);
+
+    if (error) {
+        json_append(reply, "{\"ok\":false,\"error\":\"%s\"}", error);
+        return;
+    }
+
+    reply += "{";
+    if (!json_int(&request, "id", &id)) {
+        json_append(reply, "\"id\":%d,", id);
+    }
+
+    if (json_str(&request, "op", op, sizeof(op))) {
+        reply += "\"ok\":false,\"error\":\"missing op\"}";
+        return;
+    }
+
+    if (!strcmp(op, "add_lead")) {
+        if (json_int(&request, "x", &x) || json_int(&request, "y", &y) ||
+            x < 0 || x >= (int)grid->width || y < 0 || y >= (int)grid->height) {
+            reply += "\"ok\":false,\"error\":\"bad position\"}";
+        } else if (add_lead(grid, (point){.x = x, .y = y, .obstacle = NIL})) {
+            reply += "\"ok\":false,\"error\":\"can't place pad\"}";
+        } else {
+            json_append(reply, "\"ok\":true,\"lead\":%zu}", leads.size() - 1);
+        }
+    } else if (!strcmp(op, "connect")) {
+        json_int(&request, "rule", &rule);
+
+        if (json_int(&request, "start", &start) || json_int(&request, "end", &end) ||
+            !valid_lead(start) || !valid_lead(end) || start == end) {
+            reply += "\"ok\":false,\"error\":\"bad leads\"}";
+        } else if (rule < 0 || rule >= (int)net_rules.size()) {
+            reply += "\"ok\":false,\"error\":\"bad rule\"}";
+        } else {
+            connect_leads(&leads[start], &leads[end], rule);
+            json_append(reply, "\"ok\":true,\"pending\":%zu}", connections.size());
+        }
+    } else if (!strcmp(op, "route")) {
+        size_t pending = connections.size();
+        size_t committed = traces.size();
+        double time = session_clock();
+
+        route(connections, grid);
+        connections.clear();
+
+        json_append(reply, "\"ok\":true,\"connections\":%zu,\"routed\":%zu,\"ms\":%.3f}",
+                    pending, traces.size() - committed, session_clock() - time);
+    } else if (!strcmp(op, "move")) {
+        double time = session_clock();
+
+        if (json_int(&request, "lead", &index) || !valid_lead(index) ||
+            json_int(&request, "x", &x) || json_int(&request, "y", &y) ||
+            x < 0 || x >= (int)grid->width || y < 0 || y >= (int)grid->height) {
+            reply += "\"ok\":false,\"error\":\"bad move\"}";
+        } else if (move_lead(grid, &leads[index], (point){.x = x, .y = y, .obstacle = NIL})) {
+            reply += "\"ok\":false,\"error\":\"can't place pad\"}";
+        } else {
+            json_append(reply, "\"ok\":true,\"ms\":%.3f}", session_clock() - time);
+        }
+    } else if (!strcmp(op, "query_trace")) {
+        struct trace *trace = NULL;
+
+        if (json_int(&request, "start", &start) || json_int(&request, "end", &end) ||
+            !valid_lead(start) || !valid_lead(end)) {
+            reply += "\"ok\":false,\"error\":\"bad leads\"}";
+            return;
+        }
+
+        for (auto &con : nets) {
+            if ((con.start == &leads[start] && con.end == &leads[end]) ||
+                (con.start == &leads[end] && con.end == &leads[start])) {
+                trace = find_trace(&con);
+
+                if (trace) {
+                    break;
+                }
+            }
+        }
+
+        if (!trace) {
+            reply += "\"ok\":false,\"error\":\"not routed\"}";
+            return;
+        }
+
+        json_append(reply, "\"ok\":true,\"rule\":%d,\"bound\":%.3f,\"lines\":", trace->con->rule,
+                    trace->bound);
+        append_lines(reply, trace);
+        reply += "}";
+    } else if (!strcmp(op, "snapshot")) {
+        reply += "\"ok\":true,\"leads\":[";
+
+        for (size_t i = 0; i < leads.size(); i++) {
+            json_append(reply, "%s[%d,%d]", i ? "," : "", (leads[i].orig.x + 5) / 4,
+                        (leads[i].orig.y + 5) / 4);
+        }
+
+        reply += "],\"traces\":[";
+
+        for (size_t i = 0; i < traces.size(); i++) {
+            json_append(reply, "%s{\"start\":%d,\"end\":%d,\"rule\":%d,\"bound\":%.3f,\"lines\":",
+                        i ? "," : "", lead_index(traces[i].con->start),
+                        lead_index(traces[i].con->end), traces[i].con->rule, traces[i].bound);
+            append_lines(reply, &traces[i]);
+            reply += "}";
+        }
+
+        json_append(reply, "],\"pending\":%zu}", connections.size());
+    } else {
+        reply += "\"ok\":false,\"error\":\"unknown op\"}";
+    }
+}
+
+/* Keep one board resident and answer requests until the input closes */
+int serve_board(const char *socket_path) {
+    struct zgrid zgrid = {0};
+    zgrid.height = GRID_HEIGHT;
+    zgrid.width = GRID_WIDTH;
+
+    create_zgrid(&zgrid);
+
+    int ret = serve(socket_path, [&zgrid](const char *request, std::string &reply) {
+        handle_request(&zgrid, request, reply);
+    });
+
+    delete_zgrid(&zgrid);
+
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    /* Recording is opt-in: a restart must not overwrite the log of the
+     * session someone wants to report */
+    const char *record_path = NULL;
+
+    enum { RUN_EDITOR, RUN_SERVE, RUN_CLIENT, RUN_CHECK, RUN_REPLAY } run = RUN_EDITOR;
+    const char *operand = NULL;
+    const char *script = NULL;
+    /* Unset: on in the editor only, headless runs must not depend on load */
+    int anytime = -1;
+
+    /* Every option is read before a mode runs, in whatever order */
+    for (int i = 1; i < argc; i++) {
+        /* Operand of argv[i], unless the next word is another option */
+        const char *arg = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[i + 1] : NULL;
+
+        if (!strcmp(argv[i], "--serve")) {
+            run = RUN_SERVE;
+            operand = arg;
+            i += arg ? 1 : 0;
+        } else if (!strcmp(argv[i], "--client") && arg) {
+            run = RUN_CLIENT;
+            operand = argv[++i];
+        } else if (!strcmp(argv[i], "--check") && arg && i + 2 < argc) {
+            run = RUN_CHECK;
+            operand = argv[++i];
+            script = argv[++i];
+        } else if (!strcmp(argv[i], "--replay") && arg) {
+            run = RUN_REPLAY;
+            operand = argv[++i];
+        } else if (!strcmp(argv[i], "--record")) {
+            record_path = arg ? argv[++i] : SESSION_LOG;
+        } else if (!strcmp(argv[i], "--anytime") && arg) {
+            anytime = 1;
+            route_opts.anytime_ms = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-anytime")) {
+            anytime = 0;
+        } else {
+            fprintf(stderr, "Bad option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    /* The editor would rather have a good route now than the best one later */
+    route_opts.anytime = (anytime < 0) ? run == RUN_EDITOR : anytime;
+
+    switch (run) {
+    case RUN_SERVE:
+        return serve_board(operand);
+    case RUN_CLIENT:
+        return serve_client(operand);
+    case RUN_CHECK:
+        return serve_check(operand, script);
+    case RUN_REPLAY:
+        return replay(operand);
+    case RUN_EDITOR:
+        break;
+    }
+
+    if (record_path && session_record(record_path)) {
+        fprintf(stderr, "Can't record the session to %s\n", record_path);
+    }
+
+    log_route_opts();
 
     struct point pts[GRID_WIDTH * GRID_HEIGHT];
     struct grid grid = {.width = GRID_WIDTH, .height = GRID_HEIGHT, .pts = pts};
@@ -548,8 +1900,11 @@ int main() {
     add_lead(&zgrid, (point){.x = 250, .y = 150, .obstacle = NIL});
 
     bool add_connection_mode = false;
+    bool show_obstacles = false;
     bool add_lien_mode = false;
+    bool move_mode = false;
     int first_point = false;
+    int net_class = 0;
 
     vec2 last_point{};
     struct lead *last_lead{};
@@ -567,12 +1922,35 @@ int main() {
 
         if (IsKeyPressed(KEY_L)) {
             add_lien_mode = true;
+            move_mode = false;
+        }
+
+        if (IsKeyPressed(KEY_M)) {
+            move_mode = true;
+            add_lien_mode = false;
+            first_point = false;
         }
 
         if (IsKeyPressed(KEY_ESCAPE)) {
             add_connection_mode = false;
         }
 
+        if (IsKeyPressed(KEY_N)) {
+            net_class = (net_class + 1) % net_rules.size();
+            printf("Net class %d: width %d, clearance %d\n", net_class,
+                   net_rules[net_class].width, net_rules[net_class].clearance);
+        }
+
+        if (IsKeyPressed(KEY_O)) {
+            show_obstacles = !show_obstacles;
+        }
+
+        if (IsKeyPressed(KEY_B)) {
+            set_anytime(!route_opts.anytime);
+            printf("Anytime routing %s, %.0f ms per connection\n",
+                   route_opts.anytime ? "on" : "off", route_opts.anytime_ms);
+        }
+
         /*
         if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && add_connection_mode) {
             if (first_point) {
@@ -597,7 +1975,16 @@ int main() {
 
         } else
           */
-        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && add_lien_mode) {
+        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && move_mode && first_point) {
+            Vector2 pos = GetScreenToWorld2D(GetMousePosition(), camera);
+
+            if (move_lead(&zgrid, last_lead, vector_to_point(pos))) {
+                printf("Move lead failed\n");
+            }
+
+            last_lead = {};
+            first_point = false;
+        } else if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && (add_lien_mode || move_mode)) {
             Vector2 pos = GetScreenToWorld2D(GetMousePosition(), camera);
             for (auto &lead : leads) {
                 if (CheckCollisionPointRec(pos,
@@ -609,10 +1996,7 @@ int main() {
                                            })) {
                     if (first_point) {
                         struct lead *dest_lead = &lead;
-                        connections.push_back({
-                            .start = last_lead,
-                            .end = dest_lead}
-                          );
+                        connect_leads(last_lead, dest_lead, net_class);
                         last_lead = {};
                         first_point = false;
                     } else {
@@ -666,6 +2050,10 @@ int main() {
                                    (float)-target.texture.height},
                        (Vector2){0, 0}, WHITE);
 
+        if (show_obstacles) {
+            overlay_draw(&zgrid, camera, scalex(1));
+        }
+
         for (auto &trace : traces) {
           for (auto &line : trace.lines) {
             DrawLineEx({(float)line.start.x, (float)line.start.y},
@@ -726,8 +2114,10 @@ int main() {
     }
 
     UnloadRenderTexture(target);
+    overlay_unload();
     CloseWindow();
     delete_zgrid(&zgrid);
+    session_close();
 
     return 0;
 }
@@ -0,0 +1,187 @@
+#include "overlay.hpp"
+#include <algorithm>
+#include <math.h>
+
+/* Textures of one level of detail, level L aggregating 2^L x 2^L tiles */
+struct overlay_level {
+    size_t nwidth;
+    size_t nheight;
+    /* Per texture, id 0 until the texture is first on screen */
+    std::vector<Texture2D> textures;
+    /* Per tile, the version its texture at this level was built from */
+    std::vector<unsigned int> versions;
+};
+
+static std::vector<overlay_level> levels{};
+static size_t overlay_tiles = 0;
+
+static Color obstacle_color(int obstacle, unsigned char alpha) {
+    switch (obstacle) {
+    case LINE:
+        return (Color){0, 90, 200, alpha};
+    case LEAD:
+        return (Color){200, 0, 0, alpha};
+    case VIA:
+        return (Color){140, 0, 160, alpha};
+    default:
+        return BLANK;
+    }
+}
+
+static void overlay_init(struct zgrid *grid) {
+    overlay_unload();
+
+    size_t side = std::max(grid->nwidth, grid->nheight);
+
+    for (size_t span = 1;; span *= 2) {
+        struct overlay_level level {
+            .nwidth = align_div(grid->nwidth, span),
+            .nheight = align_div(grid->nheight, span),
+        };
+
+        level.textures.resize(level.nwidth * level.nheight, (Texture2D){0});
+        level.versions.resize(grid->nzblocks, 0);
+        levels.push_back(std::move(level));
+
+        if (span >= side) {
+            break;
+        }
+    }
+
+    overlay_tiles = grid->nzblocks;
+}
+
+/* Render texture t of level l from the tiles under it: a texel holds the
+ * strongest obstacle of its 2^l x 2^l cells, opaque as they are occupied */
+static void build_texture(struct zgrid *grid, size_t l, size_t t) {
+    struct overlay_level *level = &levels[l];
+    size_t span = (size_t)1 << l;
+    size_t gx = (t % level->nwidth) * span;
+    size_t gy = (t / level->nwidth) * span;
+    unsigned char top[BLOCK_SIZE] = {0};
+    unsigned int count[BLOCK_SIZE] = {0};
+    Color pixels[BLOCK_SIZE];
+
+    for (size_t by = gy; by < std::min(gy + span, grid->nheight); by++) {
+        for (size_t bx = gx; bx < std::min(gx + span, grid->nwidth); bx++) {
+            size_t z = by * grid->nwidth + bx;
+            struct zblock *block = grid->blocks[z];
+
+            for (int i = 0; i < BLOCK_SIZE; i++) {
+                int obstacle = block->nodes[i].p.obstacle;
+
+                if (obstacle == NIL || obstacle == HALO) {
+                    continue;
+                }
+
+                size_t x = ((bx - gx) * ZWIDTH + i % ZWIDTH) >> l;
+                size_t y = ((by - gy) * ZHEIGHT + i / ZWIDTH) >> l;
+
+                top[y * ZWIDTH + x] = std::max(top[y * ZWIDTH + x], (unsigned char)obstacle);
+                count[y * ZWIDTH + x]++;
+            }
+
+            level->versions[z] = block->version;
+        }
+    }
+
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        unsigned char alpha = 96 + (159 * count[i] >> (2 * l));
+
+        pixels[i] = count[i] ? obstacle_color(top[i], alpha) : BLANK;
+    }
+
+    if (level->textures[t].id) {
+        UpdateTexture(level->textures[t], pixels);
+        return;
+    }
+
+    Image image = {
+        .data = pixels,
+        .width = ZWIDTH,
+        .height = ZHEIGHT,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+    level->textures[t] = LoadTextureFromImage(image);
+    SetTextureFilter(level->textures[t], TEXTURE_FILTER_POINT);
+}
+
+static int texture_stale(struct zgrid *grid, size_t l, size_t t) {
+    struct overlay_level *level = &levels[l];
+    size_t span = (size_t)1 << l;
+    size_t gx = (t % level->nwidth) * span;
+    size_t gy = (t / level->nwidth) * span;
+
+    if (!level->textures[t].id) {
+        return 1;
+    }
+
+    for (size_t by = gy; by < std::min(gy + span, grid->nheight); by++) {
+        for (size_t bx = gx; bx < std::min(gx + span, grid->nwidth); bx++) {
+            size_t z = by * grid->nwidth + bx;
+
+            if (grid->blocks[z]->version != level->versions[z]) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void overlay_draw(struct zgrid *grid, Camera2D camera, float cell) {
+    if (overlay_tiles != grid->nzblocks) {
+        overlay_init(grid);
+    }
+
+    /* Coarsest level whose texels still cover OVERLAY_TEXEL_MIN pixels */
+    float texel = cell * camera.zoom;
+    int l = 0;
+
+    if (texel < OVERLAY_TEXEL_MIN) {
+        l = (int)ceilf(log2f(OVERLAY_TEXEL_MIN / texel));
+    }
+
+    l = std::min(l, (int)levels.size() - 1);
+
+    struct overlay_level *level = &levels[l];
+    float side = (float)(ZWIDTH << l) * cell;
+    float origin = -HALO_WIDTH * cell;
+    Vector2 from = GetScreenToWorld2D((Vector2){0, 0}, camera);
+    Vector2 to = GetScreenToWorld2D((Vector2){(float)GetScreenWidth(), (float)GetScreenHeight()},
+                                    camera);
+
+    int x0 = std::max((int)floorf((from.x - origin) / side), 0);
+    int y0 = std::max((int)floorf((from.y - origin) / side), 0);
+    int x1 = std::min((int)floorf((to.x - origin) / side), (int)level->nwidth - 1);
+    int y1 = std::min((int)floorf((to.y - origin) / side), (int)level->nheight - 1);
+
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            size_t t = y * level->nwidth + x;
+
+            if (texture_stale(grid, l, t)) {
+                build_texture(grid, l, t);
+            }
+
+            DrawTexturePro(level->textures[t], (Rectangle){0, 0, ZWIDTH, ZHEIGHT},
+                           (Rectangle){origin + x * side, origin + y * side, side, side},
+                           (Vector2){0, 0}, 0.f, WHITE);
+        }
+    }
+}
+
+void overlay_unload(void) {
+    for (auto &level : levels) {
+        for (auto &texture : level.textures) {
+            if (texture.id) {
+                UnloadTexture(texture);
+            }
+        }
+    }
+
+    levels.clear();
+    overlay_tiles = 0;
+}
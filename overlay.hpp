@@ -0,0 +1,20 @@
+#ifndef OVERLAY_HPP
+#define OVERLAY_HPP
+
+#include "grid.hpp"
+#include "raylib.h"
+
+/* Screen pixels a texel should at least cover before a coarser level is
+ * drawn instead */
+#define OVERLAY_TEXEL_MIN 1.f
+
+/* Obstacle plane of grid, drawn in world space with cell world units per
+ * cell. Level L keeps one ZWIDTH x ZHEIGHT texture per 2^L x 2^L tiles, each
+ * rebuilt only when the version of one of its tiles moved. Only textures on
+ * screen are checked, built and drawn. Call between BeginMode2D() and
+ * EndMode2D(). */
+void overlay_draw(struct zgrid *grid, Camera2D camera, float cell);
+
+void overlay_unload(void);
+
+#endif
@@ -0,0 +1,197 @@
+#include "relax.hpp"
+#include <algorithm>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* The AVX2 kernel is built whenever the compiler can target it per function,
+ * and picked at run time unless the whole build assumes AVX2 */
+#if defined(__AVX2__)
+#define RELAX_AVX2
+#define AVX2_TARGET
+#elif defined(__SSE2__) && defined(__GNUC__)
+#define RELAX_AVX2
+#define RELAX_DISPATCH
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+alignas(32) static const int lane_dx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+alignas(32) static const int lane_dy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+alignas(32) static const int lane_step[8] = {
+    COST_DIAGONAL, COST_STRAIGHT, COST_DIAGONAL, COST_STRAIGHT,
+    COST_STRAIGHT, COST_DIAGONAL, COST_STRAIGHT, COST_DIAGONAL,
+};
+
+#if defined(RELAX_AVX2)
+
+/* All 8 neighbours in one pass of 32-bit lanes */
+AVX2_TARGET static unsigned int relax_avx2(const struct relax_params *params,
+                                           struct relax_lanes *lanes) {
+    __m256i x = _mm256_add_epi32(_mm256_set1_epi32(params->x),
+                                 _mm256_load_si256((const __m256i *)lane_dx));
+    __m256i y = _mm256_add_epi32(_mm256_set1_epi32(params->y),
+                                 _mm256_load_si256((const __m256i *)lane_dy));
+    __m256i cost = _mm256_add_epi32(_mm256_set1_epi32(params->cost),
+                                    _mm256_load_si256((const __m256i *)lane_step));
+
+    __m256i hx = _mm256_abs_epi32(_mm256_sub_epi32(x, _mm256_set1_epi32(params->dest_x)));
+    __m256i hy = _mm256_abs_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(params->dest_y)));
+    __m256i fx = _mm256_abs_epi32(_mm256_sub_epi32(x, _mm256_set1_epi32(params->first_x)));
+    __m256i fy = _mm256_abs_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(params->first_y)));
+    __m256i hmax = _mm256_max_epi32(hx, hy);
+    __m256i hmin = _mm256_min_epi32(hx, hy);
+
+    __m256i key = _mm256_add_epi32(
+        cost, _mm256_add_epi32(_mm256_mullo_epi32(hmax, _mm256_set1_epi32(COST_STRAIGHT)),
+                               _mm256_mullo_epi32(hmin, _mm256_set1_epi32(COST_DIAGONAL -
+                                                                          COST_STRAIGHT))));
+
+    __m256i zero = _mm256_setzero_si256();
+    __m256i escape_reach = _mm256_set1_epi32(params->reach + 2);
+    __m256i is_dest = _mm256_cmpeq_epi32(hmax, zero);
+    __m256i clear = _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i *)lanes->clearance),
+                                       _mm256_set1_epi32(params->reach));
+    __m256i vacant = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i *)lanes->obstacle), zero);
+    __m256i escape = _mm256_or_si256(_mm256_cmpgt_epi32(escape_reach, _mm256_max_epi32(fx, fy)),
+                                     _mm256_cmpgt_epi32(escape_reach, hmax));
+    __m256i pass = _mm256_or_si256(_mm256_or_si256(is_dest, clear), _mm256_and_si256(vacant, escape));
+    __m256i open = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i *)lanes->visited), zero);
+    __m256i better = _mm256_castps_si256(_mm256_cmp_ps(
+        _mm256_cvtepi32_ps(cost), _mm256_load_ps(lanes->distance), _CMP_LT_OQ));
+
+    _mm256_store_si256((__m256i *)lanes->cost, cost);
+    _mm256_store_si256((__m256i *)lanes->key, key);
+
+    return _mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_and_si256(_mm256_and_si256(pass, open), better)));
+}
+
+#endif
+
+#if defined(__SSE2__) && !defined(__AVX2__)
+
+/* SSE2 lacks 32-bit abs, min, max and multiply, build them from compares */
+static inline __m128i abs_epi32(__m128i a) {
+    __m128i sign = _mm_srai_epi32(a, 31);
+    return _mm_sub_epi32(_mm_xor_si128(a, sign), sign);
+}
+
+static inline __m128i select_epi32(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i mullo_epi32(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* Lanes 4 * half to 4 * half + 3 */
+static unsigned int relax_half(const struct relax_params *params, struct relax_lanes *lanes,
+                               int half) {
+    int at = 4 * half;
+    __m128i x = _mm_add_epi32(_mm_set1_epi32(params->x),
+                              _mm_load_si128((const __m128i *)(lane_dx + at)));
+    __m128i y = _mm_add_epi32(_mm_set1_epi32(params->y),
+                              _mm_load_si128((const __m128i *)(lane_dy + at)));
+    __m128i cost = _mm_add_epi32(_mm_set1_epi32(params->cost),
+                                 _mm_load_si128((const __m128i *)(lane_step + at)));
+
+    __m128i hx = abs_epi32(_mm_sub_epi32(x, _mm_set1_epi32(params->dest_x)));
+    __m128i hy = abs_epi32(_mm_sub_epi32(y, _mm_set1_epi32(params->dest_y)));
+    __m128i fx = abs_epi32(_mm_sub_epi32(x, _mm_set1_epi32(params->first_x)));
+    __m128i fy = abs_epi32(_mm_sub_epi32(y, _mm_set1_epi32(params->first_y)));
+    __m128i hgt = _mm_cmpgt_epi32(hx, hy);
+    __m128i hmax = select_epi32(hgt, hx, hy);
+    __m128i hmin = select_epi32(hgt, hy, hx);
+    __m128i fmax = select_epi32(_mm_cmpgt_epi32(fx, fy), fx, fy);
+
+    __m128i key = _mm_add_epi32(
+        cost, _mm_add_epi32(mullo_epi32(hmax, _mm_set1_epi32(COST_STRAIGHT)),
+                            mullo_epi32(hmin, _mm_set1_epi32(COST_DIAGONAL - COST_STRAIGHT))));
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i escape_reach = _mm_set1_epi32(params->reach + 2);
+    __m128i is_dest = _mm_cmpeq_epi32(hmax, zero);
+    __m128i clear = _mm_cmpgt_epi32(_mm_load_si128((const __m128i *)(lanes->clearance + at)),
+                                    _mm_set1_epi32(params->reach));
+    __m128i vacant = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)(lanes->obstacle + at)), zero);
+    __m128i escape = _mm_or_si128(_mm_cmpgt_epi32(escape_reach, fmax),
+                                  _mm_cmpgt_epi32(escape_reach, hmax));
+    __m128i pass = _mm_or_si128(_mm_or_si128(is_dest, clear), _mm_and_si128(vacant, escape));
+    __m128i open = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)(lanes->visited + at)), zero);
+    __m128i better = _mm_castps_si128(
+        _mm_cmplt_ps(_mm_cvtepi32_ps(cost), _mm_load_ps(lanes->distance + at)));
+
+    _mm_store_si128((__m128i *)(lanes->cost + at), cost);
+    _mm_store_si128((__m128i *)(lanes->key + at), key);
+
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(_mm_and_si128(pass, open), better)));
+}
+
+static unsigned int relax_sse2(const struct relax_params *params, struct relax_lanes *lanes) {
+    return relax_half(params, lanes, 0) | (relax_half(params, lanes, 1) << 4);
+}
+
+#endif
+
+#if !defined(__SSE2__)
+
+static unsigned int relax_scalar(const struct relax_params *params, struct relax_lanes *lanes) {
+    unsigned int mask = 0;
+
+    for (int k = 0; k < 8; k++) {
+        int x = params->x + lane_dx[k];
+        int y = params->y + lane_dy[k];
+        int hx = abs(x - params->dest_x);
+        int hy = abs(y - params->dest_y);
+        int fmax = std::max(abs(x - params->first_x), abs(y - params->first_y));
+        int hmax = std::max(hx, hy);
+        int cost = params->cost + lane_step[k];
+
+        bool escape = fmax <= params->reach + 1 || hmax <= params->reach + 1;
+        bool pass = !hmax || lanes->clearance[k] > params->reach ||
+                    (!lanes->obstacle[k] && escape);
+
+        lanes->cost[k] = cost;
+        lanes->key[k] = cost + COST_STRAIGHT * hmax +
+                        (COST_DIAGONAL - COST_STRAIGHT) * std::min(hx, hy);
+
+        if (pass && !lanes->visited[k] && cost < lanes->distance[k]) {
+            mask |= 1u << k;
+        }
+    }
+
+    return mask;
+}
+
+#endif
+
+#if defined(RELAX_DISPATCH)
+
+typedef unsigned int (*relax_fn)(const struct relax_params *, struct relax_lanes *);
+
+static relax_fn pick_kernel(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? relax_avx2 : relax_sse2;
+}
+
+#endif
+
+unsigned int relax_kernel(const struct relax_params *params, struct relax_lanes *lanes) {
+#if defined(RELAX_DISPATCH)
+    static const relax_fn kernel = pick_kernel();
+
+    return kernel(params, lanes);
+#elif defined(__AVX2__)
+    return relax_avx2(params, lanes);
+#elif defined(__SSE2__)
+    return relax_sse2(params, lanes);
+#else
+    return relax_scalar(params, lanes);
+#endif
+}
@@ -0,0 +1,39 @@
+#ifndef RELAX_HPP
+#define RELAX_HPP
+
+#include "grid.hpp"
+
+/* Fixed-point octile step costs. 14 undercuts 10 * sqrt(2) by 1%, so an
+ * integer-optimal path is at most ~1% longer than the float-optimal one. */
+#define COST_STRAIGHT 10
+#define COST_DIAGONAL 14
+
+/* The node being expanded and the endpoints its neighbours are judged by */
+struct relax_params {
+    int x;
+    int y;
+    /* Cost so far of the node being expanded */
+    int cost;
+    int first_x;
+    int first_y;
+    int dest_x;
+    int dest_y;
+    /* Half trace width plus clearance, see passable() */
+    int reach;
+};
+
+/* One lane per neighbour, in grid_neighbours() order. The caller gathers
+ * the node fields, the kernel fills in cost and key. */
+struct relax_lanes {
+    alignas(32) float distance[8];
+    alignas(32) int visited[8];
+    alignas(32) int clearance[8];
+    alignas(32) int obstacle[8];
+    /* Cost so far through the expanded node and its A* key */
+    alignas(32) int cost[8];
+    alignas(32) int key[8];
+};
+
+unsigned int relax_kernel(const struct relax_params *params, struct relax_lanes *lanes);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef ROUTE_HPP
+#define ROUTE_HPP
+
+#include <memory_resource>
+#include <vector>
+
+#include "grid.hpp"
+
+/* Trace data kept by the board lives in pmr containers on board_arena().
+ * Copies of a pmr container take the default resource, so board copies are
+ * made with board_trace() and board_line() */
+struct line {
+    vec2 start;
+    vec2 end;
+    std::pmr::vector<point> obstacle_points;
+};
+
+struct connection;
+struct trace;
+
+struct lead {
+  struct vec2 orig;
+  int width; 
+  int height;
+  std::pmr::vector<trace> traces;
+  /* Bumped whenever the lead moves or its traces change */
+  unsigned int revision;
+};
+
+struct trace {
+  std::pmr::vector<line> lines{};
+  struct connection *con;
+  /* Suboptimality bound of the search that found it, 0 if it has none */
+  float bound;
+};
+
+/* Net class: trace width and copper-to-copper gap, both in cells */
+struct net_rule {
+  int width;
+  int clearance;
+};
+
+struct connection {
+  struct lead *start;
+  struct lead *end;
+  /* Index into net_rules */
+  int rule;
+};
+
+struct route_options {
+  /* Route fan-out to busy leads through cached distance fields */
+  bool field_cache;
+  /* Connections a lead needs in one routing pass to get a field */
+  int hub_connections;
+  /* Side of the square lead pad, in cells */
+  int pad_width;
+  /* Let path simplification pull segments at any angle, not just 45 deg */
+  bool any_angle;
+  /* Search with 10/14 integer octile costs over a bucket queue */
+  bool integer_costs;
+  /* With integer_costs: find a first path with the heuristic inflated by
+   * anytime_weight, then improve it while the budget lasts */
+  bool anytime;
+  float anytime_weight;
+  /* Improvement budget per connection, 0 for none */
+  float anytime_ms;
+  int anytime_expansions;
+  /* Reuse the last route of a connection while the tiles under it hold */
+  bool route_cache;
+};
+
+/* What a search found: status 0 if it reached dest, its path then costs at
+ * most bound times the optimum (0 if unknown) after so many passes */
+struct search_result {
+  int status;
+  float bound;
+  int iterations;
+};
+
+extern struct route_options route_opts;
+extern std::vector<net_rule> net_rules;
+
+#endif
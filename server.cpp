@@ -0,0 +1,513 @@
+#include "server.hpp"
+#include <deque>
+#include <vector>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char *skip_space(const char *p) {
+    return p + strspn(p, " \t\r");
+}
+
+/* String token at p without escapes, copied to out. Returns the character
+ * after the closing quote, or NULL with *error set. */
+static const char *parse_string(const char *p, char *out, size_t size, const char **error) {
+    size_t len = 0;
+
+    for (p++; *p != '"'; p++) {
+        if (!*p) {
+            *error = "unterminated string";
+            return NULL;
+        }
+
+        if (*p == '\\') {
+            *error = "escapes not supported";
+            return NULL;
+        }
+
+        if ((unsigned char)*p < ' ') {
+            *error = "control character in string";
+            return NULL;
+        }
+
+        if (len + 1 >= size) {
+            *error = "string too long";
+            return NULL;
+        }
+
+        out[len++] = *p;
+    }
+
+    out[len] = '\0';
+    return p + 1;
+}
+
+const char *json_parse(const char *json, const char *const *keys, struct json_object *obj) {
+    const char *error = NULL;
+    const char *p = skip_space(json);
+
+    obj->count = 0;
+
+    if (*p++ != '{') {
+        return "expected an object";
+    }
+
+    p = skip_space(p);
+    bool more = *p != '}';
+
+    if (!more) {
+        p = skip_space(p + 1);
+    }
+
+    while (more) {
+        if (obj->count == JSON_MAX_FIELDS) {
+            return "too many members";
+        }
+
+        struct json_field *field = &obj->fields[obj->count];
+        bool known = false;
+
+        if (*p != '"') {
+            return "expected a key";
+        }
+
+        if (!(p = parse_string(p, field->key, sizeof(field->key), &error))) {
+            return error;
+        }
+
+        for (const char *const *key = keys; *key; key++) {
+            known = known || !strcmp(*key, field->key);
+        }
+
+        if (!known) {
+            return "unknown key";
+        }
+
+        for (int i = 0; i < obj->count; i++) {
+            if (!strcmp(obj->fields[i].key, field->key)) {
+                return "duplicate key";
+            }
+        }
+
+        p = skip_space(p);
+
+        if (*p++ != ':') {
+            return "expected ':'";
+        }
+
+        p = skip_space(p);
+        field->is_str = *p == '"';
+
+        if (field->is_str) {
+            if (!(p = parse_string(p, field->str, sizeof(field->str), &error))) {
+                return error;
+            }
+        } else {
+            char *end;
+
+            errno = 0;
+            long v = strtol(p, &end, 10);
+
+            if (end == p || (*p != '-' && (*p < '0' || *p > '9'))) {
+                return "values are strings or integers";
+            }
+
+            if (errno || v < INT_MIN || v > INT_MAX) {
+                return "integer out of range";
+            }
+
+            field->num = (int)v;
+            p = end;
+        }
+
+        obj->count++;
+        p = skip_space(p);
+
+        if (*p != ',' && *p != '}') {
+            return "expected ',' or '}'";
+        }
+
+        more = *p == ',';
+        p = skip_space(p + 1);
+    }
+
+    if (*p) {
+        return "trailing characters";
+    }
+
+    return NULL;
+}
+
+static struct json_field *json_field(struct json_object *obj, const char *key) {
+    for (int i = 0; i < obj->count; i++) {
+        if (!strcmp(obj->fields[i].key, key)) {
+            return &obj->fields[i];
+        }
+    }
+
+    return NULL;
+}
+
+int json_int(struct json_object *obj, const char *key, int *value) {
+    struct json_field *field = json_field(obj, key);
+
+    if (!field || field->is_str) {
+        return 1;
+    }
+
+    *value = field->num;
+    return 0;
+}
+
+int json_str(struct json_object *obj, const char *key, char *value, size_t size) {
+    struct json_field *field = json_field(obj, key);
+
+    if (!field || !field->is_str || strlen(field->str) >= size) {
+        return 1;
+    }
+
+    strcpy(value, field->str);
+    return 0;
+}
+
+void json_append(std::string &out, const char *fmt, ...) {
+    char buf[256];
+    va_list args;
+
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    if (n >= (int)sizeof(buf)) {
+        std::string big(n + 1, '\0');
+
+        va_start(args, fmt);
+        vsnprintf(&big[0], n + 1, fmt, args);
+        va_end(args);
+
+        big.resize(n);
+        out += big;
+    } else if (n > 0) {
+        out += buf;
+    }
+}
+
+static int write_all(int fd, const char *data, size_t size) {
+    while (size) {
+        ssize_t n = write(fd, data, size);
+
+        if (n <= 0) {
+            return 1;
+        }
+
+        data += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+/* Answer every complete line of pending in order, keep the rest */
+static int handle_lines(int fd, std::string &pending, request_handler &handler) {
+    size_t start = 0;
+    size_t end;
+    std::string reply {};
+
+    while ((end = pending.find('\n', start)) != std::string::npos) {
+        pending[end] = '\0';
+
+        if (end > start) {
+            reply.clear();
+            handler(pending.c_str() + start, reply);
+            reply += '\n';
+
+            if (write_all(fd, reply.data(), reply.size())) {
+                return 1;
+            }
+        }
+
+        start = end + 1;
+    }
+
+    pending.erase(0, start);
+    return 0;
+}
+
+static void serve_fd(int in, int out, request_handler &handler) {
+    std::string pending {};
+    char buf[4096];
+    ssize_t n;
+
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        pending.append(buf, n);
+
+        if (handle_lines(out, pending, handler)) {
+            return;
+        }
+    }
+
+    if (!pending.empty()) {
+        pending += '\n';
+        handle_lines(out, pending, handler);
+    }
+}
+
+/* Serve requests from stdin when socket_path is NULL, otherwise from one
+ * client of the Unix socket at a time. The board stays between clients. */
+int serve(const char *socket_path, request_handler handler) {
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!socket_path) {
+        serve_fd(STDIN_FILENO, STDOUT_FILENO, handler);
+        return 0;
+    }
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    unlink(socket_path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 4)) {
+        perror(socket_path);
+        close(fd);
+        return 1;
+    }
+
+    for (;;) {
+        int client = accept(fd, NULL, NULL);
+
+        if (client < 0) {
+            perror("accept");
+            break;
+        }
+
+        serve_fd(client, client, handler);
+        close(client);
+    }
+
+    close(fd);
+    unlink(socket_path);
+    return 1;
+}
+
+static int connect_server(const char *socket_path) {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        perror(socket_path);
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Pipe stdin to the server and print the replies as they come */
+int serve_client(const char *socket_path) {
+    int fd = connect_server(socket_path);
+
+    if (fd < 0) {
+        return 1;
+    }
+
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+    char buf[4096];
+    ssize_t n;
+
+    /* Replies are read while requests are still being sent, so a long
+     * pipeline cannot fill both socket buffers and stall */
+    while (fds[1].fd >= 0 && poll(fds, 2, -1) > 0) {
+        if (fds[0].revents) {
+            n = read(STDIN_FILENO, buf, sizeof(buf));
+
+            if (n <= 0 || write_all(fd, buf, n)) {
+                shutdown(fd, SHUT_WR);
+                fds[0].fd = -1;
+            }
+        }
+
+        if (fds[1].revents) {
+            n = read(fd, buf, sizeof(buf));
+
+            if (n <= 0) {
+                fds[1].fd = -1;
+            } else {
+                fwrite(buf, 1, n, stdout);
+                fflush(stdout);
+            }
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+/* Whole reply text matches pattern, where '*' stands for any run */
+static bool reply_matches(const char *pattern, const char *reply) {
+    if (*pattern == '*') {
+        for (;; reply++) {
+            if (reply_matches(pattern + 1, reply)) {
+                return true;
+            }
+
+            if (!*reply) {
+                return false;
+            }
+        }
+    }
+
+    if (!*pattern) {
+        return !*reply;
+    }
+
+    return *pattern == *reply && reply_matches(pattern + 1, reply + 1);
+}
+
+static int read_line(int fd, std::string &pending, std::string &line) {
+    char buf[4096];
+    size_t end;
+
+    while ((end = pending.find('\n')) == std::string::npos) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+
+        if (n <= 0) {
+            return 1;
+        }
+
+        pending.append(buf, n);
+    }
+
+    line.assign(pending, 0, end);
+    pending.erase(0, end + 1);
+    return 0;
+}
+
+/* Write every request of batch at once, then read as many replies */
+static int send_batch(int fd, std::vector<std::string> &batch, std::string &pending,
+                      std::deque<std::string> &replies) {
+    std::string requests {};
+    std::string reply {};
+
+    for (auto &request : batch) {
+        requests += request;
+        requests += '\n';
+    }
+
+    if (write_all(fd, requests.data(), requests.size())) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (read_line(fd, pending, reply)) {
+            return 1;
+        }
+
+        replies.push_back(reply);
+    }
+
+    batch.clear();
+    return 0;
+}
+
+int serve_check(const char *socket_path, const char *script_path) {
+    FILE *script = fopen(script_path, "r");
+
+    if (!script) {
+        perror(script_path);
+        return 1;
+    }
+
+    int fd = connect_server(socket_path);
+
+    if (fd < 0) {
+        fclose(script);
+        return 1;
+    }
+
+    std::string pending {};
+    std::vector<std::string> batch {};
+    std::deque<std::string> replies {};
+    char line[4096];
+    int lineno = 0;
+    int checks = 0;
+    int failed = 0;
+
+    while (fgets(line, sizeof(line), script)) {
+        bool check = !strncmp(line, "< ", 2);
+
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (!strncmp(line, ">> ", 3)) {
+            batch.push_back(line + 3);
+            continue;
+        }
+
+        if (!strncmp(line, "> ", 2)) {
+            batch.push_back(line + 2);
+        } else if (!check) {
+            continue;
+        }
+
+        if (!batch.empty() && send_batch(fd, batch, pending, replies)) {
+            fprintf(stderr, "%s:%d: server went away\n", script_path, lineno);
+            failed++;
+            break;
+        }
+
+        if (check) {
+            const char *reply = replies.empty() ? "nothing" : replies.front().c_str();
+            checks++;
+
+            if (replies.empty() || !reply_matches(line + 2, reply)) {
+                fprintf(stderr, "%s:%d: expected %s\n%s:%d: got      %s\n", script_path,
+                        lineno, line + 2, script_path, lineno, reply);
+                failed++;
+            }
+
+            if (!replies.empty()) {
+                replies.pop_front();
+            }
+        }
+    }
+
+    printf("%s: %d of %d replies as expected\n", script_path, checks - failed, checks);
+
+    fclose(script);
+    close(fd);
+    return failed != 0;
+}
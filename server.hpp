@@ -0,0 +1,49 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <functional>
+#include <string>
+
+/* Answers one request line with one reply line (no trailing newline) */
+typedef std::function<void(const char *request, std::string &reply)> request_handler;
+
+int serve(const char *socket_path, request_handler handler);
+
+int serve_client(const char *socket_path);
+
+/* Run the exchange of a script against the server: "> " lines are sent as
+ * requests, "< " lines are patterns the replies must match in order, with
+ * '*' for any run of characters. ">> " lines are held back and written in
+ * one go with the next request or check, before any of their replies is
+ * read, to test pipelining. Other lines are ignored. Returns 1 if a reply
+ * differs. */
+int serve_check(const char *socket_path, const char *script_path);
+
+#define JSON_MAX_FIELDS 16
+
+/* Requests are one flat JSON object per line whose members are strings or
+ * integers. Strings can't hold escapes; nested values, floats, true, false
+ * and null are rejected along with keys the caller doesn't know. */
+struct json_field {
+    char key[16];
+    bool is_str;
+    int num;
+    char str[64];
+};
+
+struct json_object {
+    int count;
+    struct json_field fields[JSON_MAX_FIELDS];
+};
+
+/* Parse json into obj, keys lists the accepted member names and ends with
+ * NULL. Returns NULL on success, otherwise what is wrong with the request. */
+const char *json_parse(const char *json, const char *const *keys, struct json_object *obj);
+
+int json_int(struct json_object *obj, const char *key, int *value);
+
+int json_str(struct json_object *obj, const char *key, char *value, size_t size);
+
+void json_append(std::string &out, const char *fmt, ...);
+
+#endif
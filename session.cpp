@@ -0,0 +1,103 @@
+#include "session.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static FILE *record_file = NULL;
+static double record_start = 0.;
+
+/* Indexed by SESSION_OP */
+static const char *op_names[] = {"lead", "connect", "route", "move", "opts"};
+
+double session_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000. + ts.tv_nsec / 1000000.;
+}
+
+int session_record(const char *path) {
+    session_close();
+
+    record_file = fopen(path, "w");
+    if (!record_file) {
+        return 1;
+    }
+
+    record_start = session_clock();
+    return 0;
+}
+
+void session_log(SESSION_OP op, int a, int b, int c) {
+    if (!record_file) {
+        return;
+    }
+
+    fprintf(record_file, "%.3f %s", session_clock() - record_start, op_names[op]);
+
+    switch (op) {
+    case SESSION_LEAD:
+        fprintf(record_file, " %d %d", a, b);
+        break;
+    case SESSION_CONNECT:
+    case SESSION_MOVE:
+    case SESSION_OPTS:
+        fprintf(record_file, " %d %d %d", a, b, c);
+        break;
+    case SESSION_ROUTE:
+        break;
+    }
+
+    fprintf(record_file, "\n");
+    /* Keep the log usable when the session it records crashes */
+    fflush(record_file);
+}
+
+void session_close(void) {
+    if (record_file) {
+        fclose(record_file);
+        record_file = NULL;
+    }
+}
+
+int session_load(const char *path, std::vector<session_event> &events) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return 1;
+    }
+
+    char line[128];
+    int ret = 0;
+
+    for (int lineno = 1; fgets(line, sizeof(line), file); lineno++) {
+        struct session_event event = {};
+        char op[16];
+        int n = sscanf(line, "%lf %15s %d %d %d", &event.time, op,
+                       &event.args[0], &event.args[1], &event.args[2]);
+
+        if (n < 2) {
+            continue;
+        }
+
+        if (!strcmp(op, "lead") && n == 4) {
+            event.op = SESSION_LEAD;
+        } else if (!strcmp(op, "connect") && n == 5) {
+            event.op = SESSION_CONNECT;
+        } else if (!strcmp(op, "route")) {
+            event.op = SESSION_ROUTE;
+        } else if (!strcmp(op, "move") && n == 5) {
+            event.op = SESSION_MOVE;
+        } else if (!strcmp(op, "opts") && n == 5) {
+            event.op = SESSION_OPTS;
+        } else {
+            fprintf(stderr, "%s:%d: bad session event\n", path, lineno);
+            ret = 1;
+            break;
+        }
+
+        events.push_back(event);
+    }
+
+    fclose(file);
+    return ret;
+}
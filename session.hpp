@@ -0,0 +1,38 @@
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include <vector>
+
+#define SESSION_LOG "session.log"
+
+typedef enum {
+    SESSION_LEAD = 0,
+    SESSION_CONNECT = 1,
+    SESSION_ROUTE = 2,
+    SESSION_MOVE = 3,
+    SESSION_OPTS = 4,
+} SESSION_OP;
+
+/* One user action: a lead at (x, y), a connection between lead indices
+ * args[0] and args[1] of net class args[2], a route of the pending
+ * connections, lead args[0] moved to (args[1], args[2]), or the routing
+ * options from then on: anytime search on if args[0], with a budget of
+ * args[1] us and args[2] expansions. time is in ms since the recording
+ * started. */
+struct session_event {
+    double time;
+    SESSION_OP op;
+    int args[3];
+};
+
+double session_clock(void);
+
+int session_record(const char *path);
+
+void session_log(SESSION_OP op, int a, int b, int c);
+
+void session_close(void);
+
+int session_load(const char *path, std::vector<session_event> &events);
+
+#endif